@@ -5,22 +5,110 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/opencv.hpp>
 #include <opencv2/videoio/videoio.hpp>
+#include <cstdlib>
+#include <cstring>
 
 using namespace cv;   // a "shortcut" for directly using OpenCV functions
 
+// The last few camera frames. Each slot keeps its own buffer: the camera reads straight into
+// the oldest slot, which then becomes the newest, so keeping history never copies a frame.
+// Mats count references, so a slot handed out stays valid even while it is being reused.
+class FrameRing {
+private:
+	static const int maxFrames = 8;
+	Mat slots[maxFrames];
+	int size;     // frames kept
+	int newest;   // slot of the newest frame
+	int count;    // frames pushed so far
+
+public:
+	FrameRing(int new_size) {
+		size = new_size < 1 ? 1 : new_size > maxFrames ? maxFrames : new_size;
+		newest = -1;
+		count = 0;
+	}
+
+	// the slot to read the next frame into (the oldest frame until push() is called)
+	Mat &next() {   return slots[(newest + 1) % size];   }
+
+	// the frame read into next() is now the newest
+	void push() {
+		newest = (newest + 1) % size;
+		count++;
+	}
+
+	// the frame "age" frames before the newest (0 is the newest); before the ring has filled up,
+	// the oldest frame there is stands in for older ones
+	Mat &get(int age) {
+		if (age >= count) {
+			age = count - 1;
+		}
+		if (age >= size) {
+			age = size - 1;
+		}
+		return slots[(newest - age + size) % size];
+	}
+};
+
 class MotionTracker {
 private:  // private members are accessible/modifiable only inside this class
 	// only the functions inside MotionTracker can access/modify the values
 	// of these variables
-	Mat previousPreviousFrame;   // the previous previous frame
-	Mat previousFrame;    // the previous frame
-	Mat currentFrame;
-
 	int xROI;   // define the top-left corner of our
 	int yROI;   //     region-of-interest
 	int widthROI;
 	int heightROI;
-	bool firstTime;
+
+	// Motion gating: only tiles of the ROI where the frame changed since two frames ago
+	// are searched for the colour, so a still background costs (almost) nothing
+	bool motionGated;
+	int motionThreshold;   // smallest change of a channel that counts as motion
+	static const int tileSize = 16;
+	static const int sampleStep = 4;   // the motion test looks at every 4th pixel of every 4th row
+
+	// counters
+	long long pixelsTested;   // pixels tested for the colour
+	long long tilesSkipped;   // tiles with no motion
+	long long tilesSearched;
+
+	// is the pixel x,y of "frame" in our colour (the same band inRange used)
+	bool inColour(const unsigned char *pixel) {
+		return pixel[0] <= 80 && pixel[1] <= 80 && pixel[2] >= 160;
+	}
+
+	// did anything move in "tile" between the two frames (sampled, so the test itself stays cheap)
+	bool moved(Mat now, Mat before, Rect tile) {
+		int x, y, c;
+		for (y = tile.y; y < tile.y + tile.height; y += sampleStep) {
+			const unsigned char *a = now.ptr<unsigned char>(y);
+			const unsigned char *b = before.ptr<unsigned char>(y);
+			for (x = tile.x; x < tile.x + tile.width; x += sampleStep) {
+				for (c = 0; c < 3; c++) {
+					if (abs(a[3*x + c] - b[3*x + c]) > motionThreshold) {
+						return true;
+					}
+				}
+			}
+		}
+		return false;
+	}
+
+	// add the colour pixels of "area" of "frame" to the COM sums
+	void sumColour(Mat frame, Rect area, long long &sumWeight, long long &sumWeightX, long long &sumWeightY) {
+		int x, y;
+		for (y = area.y; y < area.y + area.height; y++) { // visit pixels row-by-row
+			const unsigned char *row = frame.ptr<unsigned char>(y);
+			// inside each row, visit pixels from left to right
+			for (x = area.x; x < area.x + area.width; x++) {
+				if (inColour(row + 3*x)) {   // weight of the pixel x,y: 255 in the colour, 0 otherwise
+					sumWeight += 255;
+					sumWeightX += 255 * x;
+					sumWeightY += 255 * y;
+				}
+			}
+		}
+		pixelsTested += area.area();
+	}
 
 public:
 	MotionTracker() {   // our constructor;   an "initialization"
@@ -28,50 +116,43 @@ public:
 		yROI = 150;   //     region-of-interest
 		widthROI = 100;
 		heightROI = 100;
-		firstTime = true;
+		motionGated = false;
+		motionThreshold = 30;
+		pixelsTested = 0;
+		tilesSkipped = 0;
+		tilesSearched = 0;
 	}
 
-	void feedNewframe(Mat frame) {
-		Mat diffPrevious;     // difference between the previous and current frame
-		Mat grayDiffPrevious;
-		Mat colorOutput;
-
-		int x, y;
-		int weight, sumWeight, sumWeightX, sumWeightY;
-		int xCenter, yCenter;
-
-		if (firstTime) {
-			frame.copyTo(currentFrame);
-			frame.copyTo(previousFrame);
-			frame.copyTo(previousPreviousFrame);
-			firstTime = false;
-		}
-		previousFrame.copyTo( previousPreviousFrame );
-		currentFrame.copyTo(previousFrame);
-		frame.copyTo(currentFrame);
+	// Track the newest frame of "frames"; the motion test compares it with the frame two before it
+	void feedNewframe(FrameRing &frames) {
+		Mat frame = frames.get(0);
+		Mat previousPreviousFrame = frames.get(2);   // the previous previous frame
 
-		inRange(frame, Scalar(0,0,160), Scalar(80,80,255), colorOutput);
-
-//		// get the diff between the current frame and the second frame before it
-//		absdiff( previousPreviousFrame, frame, diffPrevious);
-//		// convert the color differences into gray differences
-//		// now, each pixel is in the range 0..255
-//		cvtColor( diffPrevious, grayDiffPrevious, CV_BGR2GRAY);
+		long long sumWeight, sumWeightX, sumWeightY;
+		int xCenter = xROI + widthROI / 2;   // stay where we are if the colour is not found
+		int yCenter = yROI + heightROI / 2;
 
+		Rect roi = Rect(xROI, yROI, widthROI, heightROI) & Rect(0, 0, frame.cols, frame.rows);
 		sumWeightX = sumWeightY = sumWeight = 0;  // set them all to zero
-		for (y = yROI; y < yROI + heightROI; y++) { // visit pixels row-by-row
-			// inside each row, visit pixels from left to right
-			for (x = xROI; x < xROI + widthROI; x++) {
-				// weight of the pixel  x,y
-				weight = colorOutput.at<unsigned char>( y,x );
-				sumWeight = sumWeight + weight;
-				sumWeightX = sumWeightX + x * weight;
-				sumWeightY += y * weight;
+		if (!motionGated) {
+			sumColour(frame, roi, sumWeight, sumWeightX, sumWeightY);
+		} else {
+			int x, y;
+			for (y = roi.y; y < roi.y + roi.height; y += tileSize) {
+				for (x = roi.x; x < roi.x + roi.width; x += tileSize) {
+					Rect tile = Rect(x, y, tileSize, tileSize) & roi;
+					if (moved(frame, previousPreviousFrame, tile)) {
+						sumColour(frame, tile, sumWeight, sumWeightX, sumWeightY);
+						tilesSearched++;
+					} else {
+						tilesSkipped++;
+					}
+				}
 			}
 		}
 		if (sumWeight != 0) {
-			xCenter = sumWeightX / sumWeight;
-			yCenter = sumWeightY / sumWeight;
+			xCenter = (int) (sumWeightX / sumWeight);
+			yCenter = (int) (sumWeightY / sumWeight);
 		}
 		xROI = xCenter - widthROI / 2;   // make the ROI "follow" the center-of-mass
 		yROI = yCenter - heightROI / 2;
@@ -99,6 +180,11 @@ public:
 		widthROI = new_widthROI;
 		heightROI = new_heightROI;
 	}
+	// Search only where something moved, "threshold" being the smallest change that counts
+	void setMotionGating(bool on, int threshold) {
+		motionGated = on;
+		motionThreshold = threshold;
+	}
 	// These functions are called accessor or "getter" functions.
 	// They are used to fetch the values of private attributes
 	// Again, these functions are like "guardians" that allow
@@ -111,6 +197,14 @@ public:
 	void drawROI(Mat frame, Scalar color) {
 		rectangle( frame, Rect(xROI,yROI,widthROI,heightROI), color, 2);
 	}
+
+	void printStats(int frames) {
+		printf("Colour tested on %lld pixels/frame", frames ? pixelsTested / frames : 0LL);
+		if (motionGated) {
+			printf(", %lld tiles searched and %lld skipped as still", tilesSearched, tilesSkipped);
+		}
+		printf("\n");
+	}
 };
 
 
@@ -119,10 +213,17 @@ int main(  int argc, char** argv ) {
 	MotionTracker mTrack1;  // our MotionTracker object is mTrack1
 	mTrack1.setROI( 10,20,150,150 );   // set mTrack1's region-of-interest
 
+	// "-motion" only searches the parts of the ROI that moved
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-motion") == 0) {
+			mTrack1.setMotionGating(true, 30);
+		}
+	}
+
 	Mat drawFrame;   // where we visualize
 
 	int frameCount;   // counts the frames that are read from the camera
-	Mat frame;   // Mat is a 2-D "matrix" of numbers, containing our image data
+	FrameRing frames(3);   // the current frame and the two before it
 	VideoCapture cap(0);   // live camera
 	if (!cap.isOpened()) {  // check if we succeeded in opening the camera
 		return -1;  // quit the program if we did not succeed
@@ -136,10 +237,12 @@ int main(  int argc, char** argv ) {
 			printf("frameCount = %d \n", frameCount);
 		}
 
-		cap >> frame;  // from the first camera
+		Mat &frame = frames.next();   // Mat is a 2-D "matrix" of numbers, containing our image data
+		cap >> frame;  // from the first camera, into the oldest frame's buffer
 		flip( frame,frame,1 );  // flip the frame horizontally
+		frames.push();
 		imshow("Raw Image", frame);  // display the frame in the window
-		mTrack1.feedNewframe(frame);
+		mTrack1.feedNewframe(frames);
 
 		frame.copyTo( drawFrame );  // create our "drawing" frame
 		mTrack1.drawROI( drawFrame,Scalar(0,0,255));  // draw mTrack1's ROI
@@ -152,5 +255,6 @@ int main(  int argc, char** argv ) {
 	}
 
 	printf("Final frameCount = %d \n", frameCount);
+	mTrack1.printStats(frameCount);
 	return 0;
 }
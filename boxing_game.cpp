@@ -23,7 +23,40 @@
 #include <opencv2/videoio/videoio.hpp>
 #include <iostream>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
 #include <string>
+#include <vector>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <new>
+#include <ctime>
+#include <set>
+#include <unordered_map>
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>	// SIMD intrinsics for the fused colour kernel
+#endif
+
+// Memory-mapped files for the match history
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#undef near	// minwindef.h leaves these behind as empty macros, which breaks any variable of that name
+#undef far
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <sys/stat.h>	// also for the settings file's modification time
 
 using namespace std;
 using namespace cv;   // a "shortcut" for directly using OpenCV functions
@@ -43,537 +76,5014 @@ public:
 	}
 };
 
-	// Class for Motion Trackers
-class moTracker: public ScreenObs {
-public:
-	// ROI Attributes
-	int xROI, yROI, wROI, hROI; 	// ROI's dimensions
-	int xCOM, yCOM; 		// coordinates of Centre of Mass
-	bool firstRun; 			// check whether it is the first time the programme runs
+	// Moments of the pixels inside a colour band, summed the way the COM loop sums an inRange mask:
+	// every matching pixel weighs 255, every other pixel 0
+struct ComMoments {
+	int64 sMass, xMass, yMass;
 
-	int topLim, leftLim, botLim, rLim; 	// ROI can only move within this region
-	bool limSet; 				// are specific limits set for ROI?
+	ComMoments () {
+		sMass = xMass = yMass = 0;
+	}
+};
 
-	// Attributes of a player
-	int xHead, yHead, headRad; 			// head set
-	int xlHand, ylHand, handRad, xrHand, yrHand; 	// hand set
-	int p2Factor; 					// applied in calculation depends on which player is using function
-	bool player2; 					// check if the ROI belongs to player 2
-	bool isTouching, hit;
-	int hitNo;
-	int xlEye;
-	int xrEye;
-	int yEye;
+	// Count the pixels of one BGR row that lie inside [lo, hi] on all three channels.
+	// "count" gets the number of matches, "idxSum" the sum of their indices within the row.
+static void bandRow (const unsigned char *p, int n, const unsigned char lo[3], const unsigned char hi[3],
+		int64 &count, int64 &idxSum) {
+	int i = 0;
+	count = idxSum = 0;
 
-	// Stamina bar attributes
-	int xBar, yBar, wBar, hBar, maxStat;
-	int xBox, yBox, wBox, hBox;
-	int countFrame;
+#if defined(__AVX2__) || defined(__SSSE3__)
+	// Shuffles that pull the B, G and R bytes of 16 interleaved pixels out of 3 x 16 bytes
+	const __m128i shB0 = _mm_setr_epi8(0,3,6,9,12,15,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1);
+	const __m128i shB1 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,2,5,8,11,14,-1,-1,-1,-1,-1);
+	const __m128i shB2 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,1,4,7,10,13);
+	const __m128i shG0 = _mm_setr_epi8(1,4,7,10,13,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1);
+	const __m128i shG1 = _mm_setr_epi8(-1,-1,-1,-1,-1,0,3,6,9,12,15,-1,-1,-1,-1,-1);
+	const __m128i shG2 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,2,5,8,11,14);
+	const __m128i shR0 = _mm_setr_epi8(2,5,8,11,14,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1);
+	const __m128i shR1 = _mm_setr_epi8(-1,-1,-1,-1,-1,1,4,7,10,13,-1,-1,-1,-1,-1,-1);
+	const __m128i shR2 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,0,3,6,9,12,15);
+#endif
 
-	moTracker () {
-		// default setROI
-		xROI = 100;
-		yROI = 200;
-		wROI = 50;
-		hROI = 50;
+#if defined(__AVX2__)
+	{
+		// 32 pixels per step: pixels 0-15 in the low lane, 16-31 in the high lane
+		const __m256i b0 = _mm256_broadcastsi128_si256(shB0), b1 = _mm256_broadcastsi128_si256(shB1),
+				b2 = _mm256_broadcastsi128_si256(shB2);
+		const __m256i g0 = _mm256_broadcastsi128_si256(shG0), g1 = _mm256_broadcastsi128_si256(shG1),
+				g2 = _mm256_broadcastsi128_si256(shG2);
+		const __m256i r0 = _mm256_broadcastsi128_si256(shR0), r1 = _mm256_broadcastsi128_si256(shR1),
+				r2 = _mm256_broadcastsi128_si256(shR2);
+		const __m256i loB = _mm256_set1_epi8((char) lo[0]), hiB = _mm256_set1_epi8((char) hi[0]);
+		const __m256i loG = _mm256_set1_epi8((char) lo[1]), hiG = _mm256_set1_epi8((char) hi[1]);
+		const __m256i loR = _mm256_set1_epi8((char) lo[2]), hiR = _mm256_set1_epi8((char) hi[2]);
+		const __m256i one = _mm256_set1_epi8(1);
+		const __m256i index = _mm256_setr_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,
+				16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31);
+		const __m256i zero = _mm256_setzero_si256();
+		__m256i vCount = zero, vIdx = zero;
 
-		hBar = 30;
-		maxStat = 160;
+		for (; i + 32 <= n; i += 32) {
+			const unsigned char *q = p + 3*i;
+			__m256i a0 = _mm256_inserti128_si256(_mm256_castsi128_si256(
+					_mm_loadu_si128((const __m128i *) q)), _mm_loadu_si128((const __m128i *) (q + 48)), 1);
+			__m256i a1 = _mm256_inserti128_si256(_mm256_castsi128_si256(
+					_mm_loadu_si128((const __m128i *) (q + 16))), _mm_loadu_si128((const __m128i *) (q + 64)), 1);
+			__m256i a2 = _mm256_inserti128_si256(_mm256_castsi128_si256(
+					_mm_loadu_si128((const __m128i *) (q + 32))), _mm_loadu_si128((const __m128i *) (q + 80)), 1);
+			__m256i b = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a0, b0),
+					_mm256_shuffle_epi8(a1, b1)), _mm256_shuffle_epi8(a2, b2));
+			__m256i g = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a0, g0),
+					_mm256_shuffle_epi8(a1, g1)), _mm256_shuffle_epi8(a2, g2));
+			__m256i r = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a0, r0),
+					_mm256_shuffle_epi8(a1, r1)), _mm256_shuffle_epi8(a2, r2));
 
-		//loop check
-		firstRun = true; // by default loop has to go through first run
-		limSet = false;  // by default no limits are set
-		p2Factor = 1;
-		player2 = false;
-		isTouching = false;
-		hit = false;
-		hitNo = 0;
-		countFrame = 0;
+			// lo <= v <= hi  <=>  max(v, lo) == v  and  min(v, hi) == v
+			__m256i in = _mm256_and_si256(
+					_mm256_cmpeq_epi8(_mm256_max_epu8(b, loB), _mm256_min_epu8(b, hiB)),
+					_mm256_cmpeq_epi8(_mm256_max_epu8(g, loG), _mm256_min_epu8(g, hiG)));
+			in = _mm256_and_si256(in,
+					_mm256_cmpeq_epi8(_mm256_max_epu8(r, loR), _mm256_min_epu8(r, hiR)));
+
+			__m256i blockCount = _mm256_sad_epu8(_mm256_and_si256(in, one), zero);
+			vCount = _mm256_add_epi64(vCount, blockCount);
+			vIdx = _mm256_add_epi64(vIdx, _mm256_sad_epu8(_mm256_and_si256(in, index), zero));
+			vIdx = _mm256_add_epi64(vIdx, _mm256_mul_epu32(blockCount, _mm256_set1_epi64x(i)));
+		}
+
+		int64 lanes[4];
+		_mm256_storeu_si256((__m256i *) lanes, vCount);
+		count += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		_mm256_storeu_si256((__m256i *) lanes, vIdx);
+		idxSum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
 	}
-	void feedNewframe (Mat frame, Scalar darker, Scalar brighter) {
-		// Mat object for color detection
-		Mat colorOutput;
+#endif
 
-		int x, y; // coordinates of pixel
-		
-		// brightness of each pixel - on x,y-axis and the sum
-		int xMass, yMass, sMass, m;
+#if defined(__AVX2__) || defined(__SSSE3__)
+	{
+		// 16 pixels per step
+		const __m128i loB = _mm_set1_epi8((char) lo[0]), hiB = _mm_set1_epi8((char) hi[0]);
+		const __m128i loG = _mm_set1_epi8((char) lo[1]), hiG = _mm_set1_epi8((char) hi[1]);
+		const __m128i loR = _mm_set1_epi8((char) lo[2]), hiR = _mm_set1_epi8((char) hi[2]);
+		const __m128i one = _mm_set1_epi8(1);
+		const __m128i index = _mm_setr_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+		const __m128i zero = _mm_setzero_si128();
+		__m128i vCount = zero, vIdx = zero;
 
-		if (firstRun) { // if this is the 1st Run!
-			xCOM = xROI + wROI/2;
-			yCOM = yROI + hROI/2;
-			
-			// Set up stamina bar
-			if (player2) {
-				xBar = (int)(frame.cols*1/16);
-				yBar = (int)(frame.rows*1/16);
-			} else {
-				xBar = (int)(frame.cols*11/16);
-				yBar = (int)(frame.rows*14/16);
-			}
-			wBar = maxStat;
-			xBox = xBar - 5;
-			yBox = yBar - 5;
-			wBox = wBar + 10;
-			hBox = hBar + 10;
-			firstRun = false; // 1st run is over
-		}
-		
-		// Color detection function that detects only the color between the "darker" and "brighter" threshold,
-		// on "colorOutput" Mat, the specific color becomes white, others becomes black background
-		inRange(frame, darker, brighter, colorOutput);
+		for (; i + 16 <= n; i += 16) {
+			const unsigned char *q = p + 3*i;
+			__m128i a0 = _mm_loadu_si128((const __m128i *) q);
+			__m128i a1 = _mm_loadu_si128((const __m128i *) (q + 16));
+			__m128i a2 = _mm_loadu_si128((const __m128i *) (q + 32));
+			__m128i b = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, shB0),
+					_mm_shuffle_epi8(a1, shB1)), _mm_shuffle_epi8(a2, shB2));
+			__m128i g = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, shG0),
+					_mm_shuffle_epi8(a1, shG1)), _mm_shuffle_epi8(a2, shG2));
+			__m128i r = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, shR0),
+					_mm_shuffle_epi8(a1, shR1)), _mm_shuffle_epi8(a2, shR2));
 
-	// Compute COM
-		sMass = xMass = yMass = 0;
-		for (y = yROI; y < yROI + hROI; y++) {
-			for (x = xROI; x < xROI + wROI; x++) {
-				m = colorOutput.at<unsigned char>(y,x);
-				sMass += m;
-				xMass += m*x;
-				yMass += m*y;
-			}
-		}
-		if (sMass != 0) {
-			xCOM = xMass/sMass;
-			yCOM = yMass/sMass;
+			__m128i in = _mm_and_si128(
+					_mm_cmpeq_epi8(_mm_max_epu8(b, loB), _mm_min_epu8(b, hiB)),
+					_mm_cmpeq_epi8(_mm_max_epu8(g, loG), _mm_min_epu8(g, hiG)));
+			in = _mm_and_si128(in, _mm_cmpeq_epi8(_mm_max_epu8(r, loR), _mm_min_epu8(r, hiR)));
+
+			__m128i blockCount = _mm_sad_epu8(_mm_and_si128(in, one), zero);
+			vCount = _mm_add_epi64(vCount, blockCount);
+			vIdx = _mm_add_epi64(vIdx, _mm_sad_epu8(_mm_and_si128(in, index), zero));
+			vIdx = _mm_add_epi64(vIdx, _mm_mul_epu32(blockCount, _mm_set1_epi64x(i)));
 		}
-	}
-	
-	// Conditions for ROI location
-	void updateROI (Mat frame) {
-		xROI = xCOM - wROI/2;
-		yROI = yCOM - hROI/2;
 
-		// Keeping the tracker inside boundaries
-			if (limSet == false) {
-				//default setLim
-				topLim = 0;
-				leftLim = 0;
-				botLim = frame.rows;
-				rLim = frame.cols;
-			}
-			if (xROI < leftLim) {
-				xROI = leftLim;
-			}
-			if (xROI + wROI > rLim) {
-				xROI = rLim - wROI;
-			}
-			if (yROI < topLim) {
-				yROI = topLim;
-			}
-			if (yROI + hROI > botLim) {
-				yROI = botLim - hROI;
-			}
+		int64 lanes[2];
+		_mm_storeu_si128((__m128i *) lanes, vCount);
+		count += lanes[0] + lanes[1];
+		_mm_storeu_si128((__m128i *) lanes, vIdx);
+		idxSum += lanes[0] + lanes[1];
 	}
-	
-	// Draw ROI on frame
-	void drawROI (Mat frame) {
-		rectangle (frame, Rect(xROI, yROI, wROI, hROI), obColour, 2);
+#endif
+
+	// Scalar fallback, and the leftover pixels of the SIMD paths
+	for (; i < n; i++) {
+		const unsigned char *q = p + 3*i;
+		if (q[0] >= lo[0] && q[0] <= hi[0] && q[1] >= lo[1] && q[1] <= hi[1]
+				&& q[2] >= lo[2] && q[2] <= hi[2]) {
+			count++;
+			idxSum += i;
+		}
 	}
+}
 
-	// Customise ROI attributes
-	void setROI (int set_xROI, int set_yROI, int set_wROI,
-			int set_hROI) {
-		xROI = set_xROI;
-		yROI = set_yROI;
-		wROI = set_wROI;
-		hROI = set_hROI;
+	// Fused threshold + centre-of-mass kernel: gives the same moments as inRange(frame, darker, brighter)
+	// followed by the COM loop over "window", in a single pass and without writing a mask
+ComMoments bandMoments (const Mat &frame, Rect window, Scalar darker, Scalar brighter) {
+	ComMoments mom;
+	unsigned char lo[3], hi[3];
+	int64 count = 0, xSum = 0, ySum = 0, rowCount, rowIdx;
+	int c, y;
+
+	// inRange compares 8-bit pixels against the bounds saturated to 0..255
+	for (c = 0; c < 3; c++) {
+		lo[c] = saturate_cast<unsigned char>(darker[c]);
+		hi[c] = saturate_cast<unsigned char>(brighter[c]);
 	}
 
-	// Customise ROI boundaries
-	void setLim (int set_topLim, int set_leftLim, int set_botLim, int set_rLim) {
-		topLim = set_topLim;
-		leftLim = set_leftLim;
-		botLim =  set_botLim;
-		rLim = set_rLim;
-		limSet = true;
+	window &= Rect(0, 0, frame.cols, frame.rows);
+	for (y = window.y; y < window.y + window.height; y++) {
+		bandRow(frame.ptr<unsigned char>(y) + 3*window.x, window.width, lo, hi, rowCount, rowIdx);
+		count += rowCount;
+		xSum += rowCount*window.x + rowIdx;
+		ySum += rowCount*y;
 	}
-	
-	// Keep ROIs not overlap one another
-	void separateROI (moTracker t1, int r1, int r2) {
-		// keeps 2 ROIs on screen from overlapping one another
-		// t1 has the coordinates and radius of reference ROI
-		//the ROI using this function will have its position changed
-		double delX = 0.0, delY = 0.0, rDist = 0.0;
-		double alpha = 0.0; // This is the angle between the second object and
-				// the horizon of the reference object (range from 0 to pi)
-		delX = xCOM - t1.xCOM;
-		delY = yCOM - t1.yCOM;
-		rDist = r1 + r2; // Magnitude of total radius distance between objects
-			// Calculate the distance between two object's centres
-		int dist = round(sqrt(pow(delX, 2.0) + pow (delY, 2.0)));
-
-		if (dist < rDist) {
-			alpha = acos ((double) (delX/dist));
-			if (delY < 0) {
-				alpha = -alpha;
-			}
-			xCOM = (int) (t1.xCOM + cos(alpha)*rDist);
-			yCOM = (int) (t1.yCOM + sin(alpha)*rDist);
+
+	mom.sMass = 255*count;
+	mom.xMass = 255*xSum;
+	mom.yMass = 255*ySum;
+	return mom;
+}
+
+	// Moments of "window" read from an existing inRange mask
+ComMoments maskMoments (const Mat &mask, Rect window) {
+	ComMoments mom;
+	int x, y, m;
+
+	for (y = window.y; y < window.y + window.height; y++) {
+		const unsigned char *row = mask.ptr<unsigned char>(y);
+		for (x = window.x; x < window.x + window.width; x++) {
+			m = row[x];
+			mom.sMass += m;
+			mom.xMass += (int64) m*x;
+			mom.yMass += (int64) m*y;
 		}
 	}
-	
-	// Behaviours of a player
-	void drawPlayer (Mat frame, moTracker leftFist, moTracker rFist) {
-		int eyeRad = (int) headRad/10;
+	return mom;
+}
 
-		headRad = (int)(wROI/2);
-		handRad = (int)(rFist.wROI/2);
+	// Colour classes of a frame's pixels: each class is a colour band and gets one bit of a label byte.
+	// A band is a box in BGR space, so membership splits per channel: each channel's table holds, for
+	// every value, the bits of the classes whose band contains it, and a pixel's label is the AND of
+	// its three entries. The tables are exact (a quantised 3-D table would move the band edges) and
+	// fit in 768 bytes, so one pass labels every class at the cost of three loads per pixel.
+class ColourClassifier {
+public:
+	static const int maxClasses = 8;
+	unsigned char table[3][256];
+	Scalar darker[maxClasses], brighter[maxClasses];
+	int classes;
 
-		// Player 2 is drawn upside down
-		if (player2) {
-			xHead = frame.cols - xCOM;
-			yHead = frame.rows - yCOM;
-			xlHand = frame.cols - leftFist.xCOM;
-			ylHand = frame.rows - leftFist.yCOM;
-			xrHand = frame.cols - rFist.xCOM;
-			yrHand = frame.rows - rFist.yCOM;
-			xlEye = frame.cols - (xCOM - headRad/3);
-			xrEye = frame.cols - (xCOM + headRad/3);
-			yEye = frame.rows - (yCOM - headRad/3);
-		} else {
-			xHead = xCOM;
-			yHead = yCOM;
-			xlHand = leftFist.xCOM;
-			ylHand = leftFist.yCOM;
-			xrHand = rFist.xCOM;
-			yrHand = rFist.yCOM;
-			xlEye = xCOM - headRad/3;
-			xrEye = xCOM + headRad/3;
-			yEye = yCOM - headRad/3;
-		}
+	ColourClassifier () {
+		clear();
+	}
 
-				// Head
-		circle (frame, Point(xHead, yHead), headRad, obColour, -1);
-				// Arms
-		line (frame, Point (xHead, yHead + p2Factor*headRad), Point (xlHand, ylHand),
-				obColour, 10);
-		line (frame, Point (xHead, yHead + p2Factor*headRad), Point (xrHand, yrHand),
-				obColour, 10);
-				// Fists
-		circle (frame, Point(xlHand, ylHand), handRad, obColour, -1);
-		circle (frame, Point(xrHand, yrHand), handRad, obColour, -1);
-				// Eyes
-		// If being hit, eyes change in to X shape
-		if (hit == true) {
-			line(frame, Point(xlEye - 10, yEye - 10), Point(xlEye + 10, yEye + 10), Scalar(0,0,0), 4);
-			line(frame, Point(xlEye + 10, yEye - 10), Point(xlEye - 10, yEye + 10), Scalar(0,0,0), 4);
+	void clear () {
+		memset(table, 0, sizeof(table));
+		classes = 0;
+	}
 
-			line(frame, Point(xrEye - 10, yEye - 10), Point(xrEye + 10, yEye + 10), Scalar(0,0,0), 4);
-			line(frame, Point(xrEye + 10, yEye - 10), Point(xrEye - 10, yEye + 10), Scalar(0,0,0), 4);
-		}
-		
-		// If not hit, eyes are black circles
-		else {
-			circle(frame, Point(xlEye, yEye), eyeRad, Scalar(0,0,0), -1);
-			circle(frame, Point(xrEye, yEye), eyeRad, Scalar(0,0,0), -1);
+	// Add the band between "darker" and "brighter" (inRange bounds), returning its bit;
+	// a band already there keeps its bit, and 0 means there is no room
+	int add (Scalar set_darker, Scalar set_brighter) {
+		int b = bit(set_darker, set_brighter);
+		if (b != 0 || classes == maxClasses) {
+			return b;
 		}
-		
-				// Smile
-		int xSmile = xHead;
-		int ySmile = yHead;
-
-		// If being hit, mouth changes into a black circle
-		if (hit == true) {
-			if (player2) {
-				circle(frame, Point(xHead, yHead - 20), 20, Scalar(0,0,0), -1);
-			} else {
-				circle(frame, Point(xHead, yHead + 40), 20, Scalar(0,0,0), -1);
+		darker[classes] = set_darker;
+		brighter[classes] = set_brighter;
+		for (int c = 0; c < 3; c++) {
+			int lo = saturate_cast<unsigned char>(set_darker[c]);
+			int hi = saturate_cast<unsigned char>(set_brighter[c]);
+			for (int v = lo; v <= hi; v++) {
+				table[c][v] |= 1 << classes;
 			}
 		}
-		
-		// If not hit, smile !!
-		else {
-			if (player2) {
-				ellipse(frame, Point(xSmile, ySmile), Size(headRad/2, headRad/2), 180, 0, 180, Scalar(0,0,0), 4, 8);
-			} else {
-				ellipse(frame, Point(xSmile, ySmile), Size(headRad/2, headRad/2), 180, 0, -180, Scalar(0,0,0), 4, 8);
+		return 1 << classes++;
+	}
+
+	// Bit of the class with exactly this band, 0 if there is none
+	int bit (Scalar set_darker, Scalar set_brighter) const {
+		for (int k = 0; k < classes; k++) {
+			if (darker[k] == set_darker && brighter[k] == set_brighter) {
+				return 1 << k;
 			}
 		}
-
-	}
-	
-	// Set factors for player 2
-	void p2 () {
-		p2Factor = -1;
-		player2 = true;
+		return 0;
 	}
-	
-	// Keep 2 players from overlapping one another
-	void separatePlayers (Mat frame, moTracker t1, int r1, int r2, bool Hit) { 
-		// t1 has the coordinates and radius of reference player
-		// the ROI using this function will have its position changed
-		
-		int rDist = 0;
-		double delX = 0.0, delY = 0.0;
-		double alpha = 0.0; 	// This is the angle between the second object and
-					// the horizon of the reference object (range from 0 to pi)
-		delX = p2Factor*((xCOM + t1.xCOM) - frame.cols);
-		delY = p2Factor*((yCOM + t1.yCOM) - frame.rows);
-		rDist = r1 + r2; 	// Magnitude of total radius distance between objects
-					// Calculate the distance between two object's centres
-		int dist = round(sqrt(pow(delX, 2.0) + pow (delY, 2.0)));
-
-		// If any 2 ROIs meet each other, they bounces back in the same direction in which they come in
-		if (dist < rDist) {
-			alpha = acos ((double) (delX/dist));
-			if (delY < 0) {
-				alpha = -alpha;
-			}
-			xCOM = (int) (frame.cols - t1.xCOM + p2Factor*cos(alpha)*rDist);
-			yCOM = (int) (frame.rows - t1.yCOM + p2Factor*sin(alpha)*rDist);
-		}
-		
-		// Decide when fist is touching head
-		if (dist > rDist - 10 && dist < rDist + 10 && Hit == true){
-			isTouching = true;
-		}
-		
-		// Decide when fist parts from head
-		else if (dist > (rDist + 30) && Hit == true) {
-			isTouching = false;
+
+	// Label the pixels of "region" of "frame" into the same region of "labels"
+	void label (const Mat &frame, Rect region, Mat &labels) const {
+		const unsigned char *b = table[0], *g = table[1], *r = table[2];
+		for (int y = region.y; y < region.y + region.height; y++) {
+			const unsigned char *p = frame.ptr<unsigned char>(y) + 3*region.x;
+			unsigned char *out = labels.ptr<unsigned char>(y) + region.x;
+			for (int x = 0; x < region.width; x++, p += 3) {
+				out[x] = b[p[0]] & g[p[1]] & r[p[2]];
+			}
 		}
 	}
-	
-	// Stamina and health bar
-	void stamina (Mat frame, moTracker LFist, moTracker rFist) {
-		// This function is only used by head motion tracker of each player
+};
 
-		// If fist and head are touching, it counts as a hit
-		if (LFist.isTouching || rFist.isTouching) {
-			if (!hit && hitNo < 5) {
-				hitNo ++;
-				hit = true;
-			}
-		} else if (!LFist.isTouching && !rFist.isTouching) { hit = false; }
-		
-		// If not being hit for a period of time, the player recovers health
-		if (!hit) {
-			countFrame++;
-			if (countFrame % 100 == 0 && hitNo > 0) {
-				hitNo--;
-			}
-		} else countFrame = 0;
-		
-		// Visualise stamina bar
-		wBar = (5 - hitNo)*maxStat/5;
+	// Moments of "window" of a label image, counting the pixels of the class "bit" as the mask path does
+ComMoments labelMoments (const Mat &labels, Rect window, int bit) {
+	ComMoments mom;
+	int64 count = 0, xSum = 0, ySum = 0, rowCount, rowIdx;
 
-		if (!player2) {
-			xBar = (int)(frame.cols*11/16) + hitNo/5*maxStat;
+	for (int y = window.y; y < window.y + window.height; y++) {
+		const unsigned char *row = labels.ptr<unsigned char>(y) + window.x;
+		rowCount = rowIdx = 0;
+		for (int x = 0; x < window.width; x++) {
+			int in = (row[x] & bit) != 0;
+			rowCount += in;
+			rowIdx += in*x;
 		}
-		
-		// Representation of stamina
-		rectangle (frame, Rect(xBar, yBar, wBar, hBar),
-									Scalar (0,0,255), -1);
+		count += rowCount;
+		xSum += rowCount*window.x + rowIdx;
+		ySum += rowCount*y;
+	}
 
-		// Representation of stamina's border case
-		rectangle (frame, Rect(xBox, yBox, wBox, hBox),
-									Scalar (255,255,255), 2);
+	mom.sMass = 255*count;
+	mom.xMass = 255*xSum;
+	mom.yMass = 255*ySum;
+	return mom;
+}
+
+	// Frame-sized buffers for the game loop, carved out of one allocation made once the frame size
+	// is known. Consumers take their buffers once and keep them, so that after the first frame the
+	// loop never allocates a frame, mask or game window again. The pool must outlive its buffers.
+class BufferPool {
+public:
+	int rows, cols;
+	Mat arena;		// backing store of every buffer
+	size_t used;		// bytes handed out so far
+	int64 overflows;	// buffers that did not fit and were allocated on their own
 
+	BufferPool (int set_rows, int set_cols, int colourBuffers, int maskBuffers) {
+		rows = set_rows;
+		cols = set_cols;
+		arena.create(1, rows*cols*(3*colourBuffers + maskBuffers), CV_8UC1);
+		used = 0;
+		overflows = 0;
 	}
-};
-// Finish motion tracker & player setup
 
-int main(  int argc, char** argv ) {
+	// Next free frame-sized buffer of "type" (CV_8UC3 or CV_8UC1)
+	Mat take (int type) {
+		size_t bytes = (size_t) rows*cols*CV_ELEM_SIZE(type);
+		if (used + bytes > arena.total()) {
+			overflows++;
+			return Mat(rows, cols, type);
+		}
+		Mat buffer = Mat(rows, cols, type, arena.data + used);
+		used += bytes;
+		return buffer;
+	}
 
-	int frameCount;
-	Mat frame;
-	Mat frame2;
+	// Move "frame" into a pooled buffer, so that reading the next frame into it reuses that buffer.
+	// Frames of another size keep their own buffer.
+	void adopt (Mat &frame) {
+		if (frame.rows == rows && frame.cols == cols && frame.type() == CV_8UC3) {
+			Mat buffer = take(CV_8UC3);
+			frame.copyTo(buffer);
+			frame = buffer;
+		}
+	}
+};
 
-	// File to keep record of winners
-	FILE *history;
+	// Colour masks of one camera's frame, shared by all trackers looking at that frame
+class MaskCache {
+public:
+	// One colour band thresholded on one frame
+	struct Entry {
+		const unsigned char *frameData;	// frame identity: its pixel buffer ...
+		int frameNo;			// ... and which capture filled it
+		Scalar darker, brighter;	// threshold pair
+		Mat mask;			// frame-sized mask, valid only inside "done"
+		vector<Rect> done;		// regions already thresholded
+	};
+	vector<Entry> entries;
+	BufferPool *pool;	// where the masks come from, NULL to allocate them here
 
-	string winner;
+	// Label image of all colour classes, for trackers on the label path
+	ColourClassifier classes;
+	Mat labelImage;
+	const unsigned char *labelFrame;	// frame identity, as in Entry
+	int labelFrameNo;
+	vector<Rect> labelled;			// regions of labelImage that are up to date
 
-	// Players' name
-	char player1[10];
-	char player2[10];
+	// BGR pixels of a frame the camera delivered as packed YUYV, converted only where trackers look
+	Mat bgrImage;
+	const unsigned char *bgrFrame;		// frame identity, as in Entry
+	int bgrFrameNo;
+	vector<Rect> converted;			// regions of bgrImage that are up to date
 
-	// Prompt the players to enter their name before starting the game
-	do {
-		printf("Enter name for Player 1: \n");
-		scanf("%s", player1);
-	} while (player1 == NULL);
+	// Counters
+	int64 passes;		// inRange calls actually made
+	int64 reuses;		// requests answered from an existing mask
+	int64 pixelsThresholded;
+	int64 labelPasses;	// label passes actually made, each covering every class
+	int64 pixelsLabelled;
+	int64 conversions;	// YUYV regions converted to BGR
+	int64 pixelsConverted;
 
-	do {
-		printf("Enter name for Player 2: \n");
-		scanf("%s", player2);
-	} while (player2 == NULL);
+	MaskCache () {
+		pool = NULL;
+		labelFrame = NULL;
+		labelFrameNo = -1;
+		bgrFrame = NULL;
+		bgrFrameNo = -1;
+		passes = 0;
+		reuses = 0;
+		pixelsThresholded = 0;
+		labelPasses = 0;
+		pixelsLabelled = 0;
+		conversions = 0;
+		pixelsConverted = 0;
+	}
 
-	// Convert players' name to string type in order to use putText function
-	string player1Str = player1;
-	string player2Str = player2;
+	// "frame" in BGR, valid at least inside "region". BGR frames (CV_8UC3) are returned as they are. Packed
+	// YUYV frames (CV_8UC2, the only other type a FrameSource delivers, see CameraSource) are converted into a frame-sized buffer one region at a time,
+	// so only what the trackers read is converted, and each pixel at most once per frame.
+	Mat colour (Mat frame, int frameNo, Rect region) {
+		if (frame.type() != CV_8UC2) {
+			return frame;
+		}
+		if (bgrImage.empty() && pool != NULL) {
+			bgrImage = pool->take(CV_8UC3);
+		}
+		if (bgrFrame != frame.data || bgrFrameNo != frameNo) {
+			bgrFrame = frame.data;
+			bgrFrameNo = frameNo;
+			converted.clear();
+			bgrImage.create(frame.rows, frame.cols, CV_8UC3);
+		}
 
-	VideoCapture cap(0); 	// open the default camera
-	if (!cap.isOpened()) {  // check if we succeeded
-		return -1;
-	}
-	VideoCapture cap2(1); 	// open the default camera
-	if (!cap2.isOpened()) {  // check if we succeeded
-		return -1;
+		// Two neighbouring pixels share their U and V: convert whole pairs
+		region &= Rect(0, 0, frame.cols, frame.rows);
+		int left = region.x & ~1, right = min(frame.cols, (region.x + region.width + 1) & ~1);
+		region = Rect(left, region.y, max(0, right - left), region.height);
+		for (size_t j = 0; j < converted.size(); j++) {
+			if ((region & converted[j]) == region) {
+				return bgrImage;
+			}
+		}
+		if (region.area() > 0) {
+			Mat out = bgrImage(region); // cvtColor writes straight into the shared buffer
+			cvtColor(frame(region), out, COLOR_YUV2BGR_YUYV);
+			converted.push_back(region);
+			conversions++;
+			pixelsConverted += region.area();
+		}
+		return bgrImage;
 	}
-	cap  >> frame;
-	cap2 >> frame2;
 
-	// Declare players
-	Mat game = Mat (frame.rows, frame.cols, CV_8UC3);
-	Mat game2 = Mat (frame.rows, frame.cols, CV_8UC3);
-	moTracker p1, p1LHand, p1RHand;
-	moTracker p2, p2LHand, p2RHand;
-	p2.p2(); p2LHand.p2(); p2RHand.p2();
+	// Label with these classes from now on
+	void useClasses (const ColourClassifier &set_classes) {
+		classes = set_classes;
+		labelFrame = NULL;
+	}
 
-	// Setup players
-	p1.setROI (frame.cols/2 - 100, 200, 150, 150);
-	p1.setColour(Scalar(255,0,0));
-	p1.setLim (frame.rows/2, (int)(frame.cols*1/7), frame.rows,
-			(int)(frame.cols*6/7));
-	p1LHand.setROI (10, 300, 100, 100);
-	p1RHand.setROI (frame.cols-10, 300, 100, 100);
-
-	p2.setROI (frame2.cols/2 - 100, 200, 150, 150);
-	p2.setLim (frame2.rows/2, (int)(frame2.cols*1/7), frame2.rows,
-			(int)(frame2.cols*6/7));
-	p2LHand.setROI (10, 300, 100, 100);
-	p2.setColour (Scalar (0,255,0));
-	p2RHand.setROI (frame2.cols-10, 300, 100, 100);
+	// Label image of "frame", valid at least inside "region": bit k of a pixel is set if it is in class k
+	// of "classes". One pass over a region labels it for every class.
+	const Mat &labels (Mat frame, int frameNo, Rect region) {
+		if (labelImage.empty() && pool != NULL) {
+			labelImage = pool->take(CV_8UC1);
+		}
+		if (labelFrame != frame.data || labelFrameNo != frameNo) {
+			labelFrame = frame.data;
+			labelFrameNo = frameNo;
+			labelled.clear();
+			labelImage.create(frame.rows, frame.cols, CV_8UC1);
+		}
 
-	namedWindow("Player 1 ROI", CV_WINDOW_NORMAL);
-	namedWindow("Player 2 ROI", CV_WINDOW_NORMAL);
-	namedWindow("Boxing Game 1", CV_WINDOW_NORMAL);
-	namedWindow("Boxing Game 2", CV_WINDOW_NORMAL);
+		region &= Rect(0, 0, frame.cols, frame.rows);
+		for (size_t j = 0; j < labelled.size(); j++) {
+			if ((region & labelled[j]) == region) {
+				reuses++;
+				return labelImage;
+			}
+		}
+		if (region.area() > 0) {
+			classes.label(frame, region, labelImage);
+			labelled.push_back(region);
+			labelPasses++;
+			pixelsLabelled += region.area();
+		}
+		return labelImage;
+	}
 
-	for(frameCount = 0; frameCount < 100000000; frameCount++) {
+	// Take the masks of new colour bands from "set_pool"
+	void useBuffers (BufferPool &set_pool) {
+		pool = &set_pool;
+	}
 
-		cap >> frame; // get a new frame from camera
-		cap2 >> frame2;
+	// Mask of "frame" between "darker" and "brighter", valid at least inside "region".
+	// Each band is thresholded once per frame no matter how many trackers ask for it.
+	const Mat &mask (Mat frame, int frameNo, Scalar darker, Scalar brighter, Rect region) {
+		Entry *e = NULL;
+		size_t i, j;
 
-		//Calculate COM and feed each frame captured
-		p1.feedNewframe(frame, Scalar(10,10,194), Scalar(125,125,249));
-		p1LHand.feedNewframe(frame, Scalar(0,164,164), Scalar(125,255,255));
-		p1RHand.feedNewframe(frame, Scalar(0,164,164), Scalar(125,255,255));
+		for (i = 0; i < entries.size() && e == NULL; i++) {
+			if (entries[i].darker == darker && entries[i].brighter == brighter) {
+				e = &entries[i];
+			}
+		}
+		if (e == NULL) {
+			entries.push_back(Entry());
+			e = &entries.back();
+			e->darker = darker;
+			e->brighter = brighter;
+			e->frameData = NULL;
+			if (pool != NULL) {
+				e->mask = pool->take(CV_8UC1);
+			}
+		}
 
-		p2.feedNewframe(frame2, Scalar(10,10,194), Scalar(125,125,249));
-		p2LHand.feedNewframe(frame2, Scalar(0,164,164), Scalar(125,255,255));
-		p2RHand.feedNewframe(frame2, Scalar(0,164,164), Scalar(125,255,255));
+		// A new frame makes every region of the old mask stale
+		if (e->frameData != frame.data || e->frameNo != frameNo) {
+			e->frameData = frame.data;
+			e->frameNo = frameNo;
+			e->done.clear();
+			e->mask.create(frame.rows, frame.cols, CV_8UC1);
+		}
 
-		// Separate the ROIs of one player
-		p1LHand.separateROI (p1, p1.headRad, p1.handRad);
-		p1RHand.separateROI (p1, p1.headRad, p1.handRad);
-		if (p1.xlHand + p1.handRad < p1.xHead) {
-			p1RHand.separateROI (p1LHand, p1.handRad, p1.handRad);
-		} else {
-			p1LHand.separateROI (p1RHand, p1.handRad, p1.handRad);
+		region &= Rect(0, 0, frame.cols, frame.rows);
+		for (j = 0; j < e->done.size(); j++) {
+			if ((region & e->done[j]) == region) {
+				reuses++;
+				return e->mask;
+			}
 		}
 
-		p2LHand.separateROI (p2,p2.headRad, p2.handRad);
-		p2RHand.separateROI (p2, p2.headRad, p2.handRad);
-		if (p2.xlHand + p2.handRad < p2.xHead) {
-			p2RHand.separateROI (p2LHand, p2.handRad, p2.handRad);
-		} else {
-			p2LHand.separateROI (p2RHand, p2.handRad, p2.handRad);
+		if (region.area() > 0) {
+			Mat out = e->mask(region); // inRange writes straight into the shared mask
+			inRange(frame(region), darker, brighter, out);
+			e->done.push_back(region);
+			passes++;
+			pixelsThresholded += region.area();
 		}
+		return e->mask;
+	}
 
-		// Separate the two players
-		if (p1.ylHand - p1.handRad >= frame.rows/2) {
-			p2LHand.separatePlayers(frame, p1LHand, p1.handRad, p2.handRad, false);
-			p2RHand.separatePlayers(frame, p1LHand, p1.handRad, p2.handRad, false);
-			p2LHand.separatePlayers(frame, p1RHand, p1.handRad, p2.handRad, false);
-			p2RHand.separatePlayers(frame, p1RHand, p1.handRad, p2.handRad, false);
-		} else {
-			p1LHand.separatePlayers(frame, p2LHand, p1.handRad, p2.handRad, false);
-			p1RHand.separatePlayers(frame, p2LHand, p1.handRad, p2.handRad, false);
-			p1LHand.separatePlayers(frame, p2RHand, p1.handRad, p2.handRad, false);
-			p1RHand.separatePlayers(frame, p2RHand, p1.handRad, p2.handRad, false);
+	void printStats (string name) {
+		printf("%-8s mask cache: %lld inRange passes, %lld label passes, %lld reuses, %lld pixels thresholded, "
+				"%lld labelled\n", name.c_str(), (long long) passes, (long long) labelPasses, (long long) reuses,
+				(long long) pixelsThresholded, (long long) pixelsLabelled);
+		if (conversions > 0) {
+			printf("%-8s YUYV frames: %lld regions converted to BGR, %lld pixels\n", name.c_str(),
+					(long long) conversions, (long long) pixelsConverted);
 		}
-		p2LHand.separatePlayers(frame, p1, p1.headRad, p2.handRad, true);
-		p2RHand.separatePlayers(frame, p1, p1.headRad, p2.handRad, true);
-		p1LHand.separatePlayers(frame, p2, p2.headRad, p1.handRad, true);
-		p1RHand.separatePlayers(frame, p2, p2.headRad, p1.handRad, true);
+	}
+};
 
-		// Update final position of ROI
-		p1.updateROI(frame);
-		p1LHand.updateROI(frame);
-		p1RHand.updateROI(frame);
+	// Downsampled copies of a region of one camera's frame (level n is 1/2^n the size). Only the region
+	// a coarse search looks at is downsampled, so the cost follows the ROI and not the frame size.
+	// The buffers are reused by every tracker of the camera, one after another.
+class FramePyramid {
+public:
+	static const int maxLevel = 3;
 
-		p2.updateROI(frame2);
-		p2LHand.updateROI(frame2);
-		p2RHand.updateROI(frame2);
+	Mat levels[maxLevel + 1];	// levels[0] is the region of the frame itself
 
-				// Visualise each ROI on frame
-		p1.drawROI (frame);
-		p1LHand.drawROI (frame);
-		p1RHand.drawROI (frame);
+	// Counters
+	int64 pyrDowns;
+	int64 pixelsDownsampled;	// full-resolution and intermediate pixels read by pyrDown
 
-		p2.drawROI (frame2);
-		p2LHand.drawROI (frame2);
-		p2RHand.drawROI (frame2);
+	FramePyramid () {
+		pyrDowns = 0;
+		pixelsDownsampled = 0;
+	}
 
-		imshow("Player 1 ROI", frame);
-		imshow("Player 2 ROI", frame2);
+	// Level "level" of "region" of "frame". The region is cut to whole 2^level blocks from its top left
+	// corner, so coarse pixel (x, y) covers the block at region.tl() + 2^level (x, y). "pixels" gets the
+	// pixels pyrDown read.
+	const Mat &level (Mat frame, Rect region, int level, int64 &pixels) {
+		level = min(level, (int) maxLevel);
+		int scale = 1 << level;
+		region &= Rect(0, 0, frame.cols, frame.rows);
+		levels[0] = frame(Rect(region.x, region.y, region.width/scale*scale, region.height/scale*scale));
+		pixels = 0;
+		for (int l = 0; l < level; l++) {
+			// reuses the level's buffer once it has the size
+			pyrDown(levels[l], levels[l + 1]);
+			pixels += levels[l].total();
+			pyrDowns++;
+		}
+		pixelsDownsampled += pixels;
+		return levels[level];
+	}
+};
 
-		// If neither player runs out of health, show game interface
-		if (not (p1.wBar == 0 || p2.wBar == 0)) {
-					// Visualise players on game window
-				// A black background to erase previous image
+	// A connected component of one colour band
+struct Blob {
+	int area;		// pixels
+	double x, y;		// centroid, i.e. the COM of the component's mask
+};
 
-			rectangle (game, Rect(0,0, frame.cols, frame.rows), Scalar (0,0,0), -1);
-			p1.drawPlayer (game, p1LHand, p1RHand);
-			p1.stamina (game, p2LHand, p2RHand);
-			p2.drawPlayer (game, p2LHand, p2RHand);
-			p2.stamina (game, p1LHand, p1RHand);
+	// Connected components of the colour bands of one camera's frame. Each band is thresholded and
+	// labelled once per frame over the region all its trackers can reach, instead of every tracker
+	// scanning its own window.
+class BlobFinder {
+public:
+	Mat labels;		// frame-sized label image, written only inside the region labelled
+	Mat classMask;		// one class taken out of the colour-class labels, inside the region
+	Mat stats, centroids;
+	vector<Blob> blobs;
+	vector<Blob> first;	// components of the first region, while findEither labels the second
+	int minArea;		// smaller components are noise
 
-			game.copyTo(game2);
+	// Counters
+	int64 passes;
+	int64 pixelsLabelled;
+	int64 ticks;
 
-			putText(game, player2Str, Point(400,70), FONT_HERSHEY_PLAIN, 3, Scalar(255,255,255), 2);
-			putText(game, player1Str, Point(150,450), FONT_HERSHEY_PLAIN, 3, Scalar(255,255,255), 2);
+	BlobFinder () {
+		minArea = 20;
+		passes = 0;
+		pixelsLabelled = 0;
+		ticks = 0;
+	}
 
-			imshow("Boxing Game 1", game);
+	// Components of "frame" between "darker" and "brighter" inside "region", taken from the colour-class
+	// labels if "useLabels" and the band is one of the classes, otherwise from an inRange mask
+	const vector<Blob> &find (Mat frame, int frameNo, Scalar darker, Scalar brighter, Rect region, MaskCache &masks,
+			bool useLabels) {
+		int64 start = getTickCount();
 
-			flip (game2, game2, -1); // flip image on both axes
-			putText(game2, player1Str, Point(400,70), FONT_HERSHEY_PLAIN, 3, Scalar(255,255,255), 2);
-			putText(game2, player2Str, Point(150,450), FONT_HERSHEY_PLAIN, 3, Scalar(255,255,255), 2);
-			imshow("Boxing Game 2", game2);
+		blobs.clear();
+		region &= Rect(0, 0, frame.cols, frame.rows);
+		if (region.area() == 0) {
+			return blobs;
 		}
+		frame = masks.colour(frame, frameNo, region);
 
-		// If either player runs out of health, show "You Win/Lose" window
-		if (p1.wBar == 0) {
-			winner = player2Str;
-
-			rectangle (game, Rect(0,0, frame.cols, frame.rows), Scalar (0,0,0), -1);
-			putText(game, "You Win!", Point(80,300), FONT_HERSHEY_TRIPLEX, 3, Scalar(0,0,255), 2, 8);
-			imshow("Boxing Game 2", game);
-
-			rectangle (game, Rect(0,0, frame.cols, frame.rows), Scalar (0,0,0), -1);
-			putText(game, "You Lose!", Point(70,250), FONT_HERSHEY_TRIPLEX, 3, Scalar(0,0,255), 2, 8);
-			imshow("Boxing Game 1", game);
+		int bit = useLabels ? masks.classes.bit(darker, brighter) : 0;
+		Mat regionMask;
+		if (bit != 0) {
+			// any non-zero pixel is foreground to connectedComponents
+			classMask.create(frame.rows, frame.cols, CV_8UC1);
+			regionMask = classMask(region);
+			bitwise_and(masks.labels(frame, frameNo, region)(region), Scalar(bit), regionMask);
+		} else {
+			regionMask = masks.mask(frame, frameNo, darker, brighter, region)(region);
 		}
+		labels.create(frame.rows, frame.cols, CV_32S);
+		Mat regionLabels = labels(region);
+		int n = connectedComponentsWithStats(regionMask, regionLabels, stats, centroids, 8, CV_32S);
 
-		else if (p2.wBar == 0) {
-			winner = player1Str;
-
-			rectangle (game, Rect(0,0, frame.cols, frame.rows), Scalar (0,0,0), -1);
-			putText(game, "You Win!", Point(80,300), FONT_HERSHEY_TRIPLEX, 3, Scalar(0,0,255), 2, 8);
-			imshow("Boxing Game 1", game);
-
-			rectangle (game, Rect(0,0, frame.cols, frame.rows), Scalar (0,0,0), -1);
-			putText(game, "You Lose!", Point(70,250), FONT_HERSHEY_TRIPLEX, 3, Scalar(0,0,255), 2, 8);
-			imshow("Boxing Game 2", game);
+		// Label 0 is the background
+		for (int i = 1; i < n; i++) {
+			Blob b;
+			b.area = stats.at<int>(i, CC_STAT_AREA);
+			if (b.area < minArea) {
+				continue;
+			}
+			b.x = region.x + centroids.at<double>(i, 0);
+			b.y = region.y + centroids.at<double>(i, 1);
+			blobs.push_back(b);
 		}
 
+		passes++;
+		pixelsLabelled += region.area();
+		ticks += getTickCount() - start;
+		return blobs;
+	}
 
-		if (waitKey(20) >= 0) {
-			break;
+	// Components inside either of two regions: their bounding box when it is no bigger than the two
+	// regions together, otherwise each region on its own, so that fists far apart do not cost the
+	// whole width of the frame between them. A component found in both is only kept once.
+	const vector<Blob> &findEither (Mat frame, int frameNo, Scalar darker, Scalar brighter, Rect a, Rect b,
+			MaskCache &masks, bool useLabels) {
+		Rect both = a | b;
+		if (both.area() <= a.area() + b.area()) {
+			return find(frame, frameNo, darker, brighter, both, masks, useLabels);
+		}
+		first = find(frame, frameNo, darker, brighter, a, masks, useLabels); // keeps its capacity
+		find(frame, frameNo, darker, brighter, b, masks, useLabels);
+		for (size_t i = 0; i < blobs.size(); i++) {
+			if (!a.contains(Point((int) blobs[i].x, (int) blobs[i].y))) {
+				first.push_back(blobs[i]);
+			}
 		}
+		blobs.swap(first);
+		return blobs;
 	}
 
-	// After the game ends, record winner's name
-	char winnerChar[winner.size() + 1];
-	strcpy(winnerChar, winner.c_str());
+	void printStats (string name) {
+		printf("%-8s blobs: %lld labelling passes, %.3f ms/pass, %lld pixels/pass\n",
+				name.c_str(), (long long) passes,
+				passes ? ticks*1000.0/getTickFrequency()/passes : 0.0,
+				passes ? (long long) (pixelsLabelled/passes) : 0LL);
+	}
+};
+
+	// Everything derived from one camera's current frame, shared by that player's trackers
+struct CameraCache {
+	MaskCache masks;	// colour masks
+	FramePyramid pyramid;	// downsampled copies
+	BlobFinder blobs;	// connected components of the colour bands
+};
+
+	// Where the game loop gets a player's frames from
+class FrameSource {
+public:
+	virtual ~FrameSource () {}
+	virtual bool isOpened () = 0;
+	// Read the next frame into "frame", reusing its buffer; false when the source has run out
+	virtual bool read (Mat &frame) = 0;
+	// Live sources keep running whether or not the game loop keeps up with them,
+	// recorded and synthetic ones deliver every frame in order
+	virtual bool live () {
+		return false;
+	}
+	// Frame rate the source delivers at, 0 if unknown or unlimited
+	virtual double fps () {
+		return 0.0;
+	}
+};
 
-	history = fopen("winners.txt", "a");
-	fprintf(history, "%s \n", winnerChar);
-	fclose(history);
+	// Live camera. "fourcc" asks it for a pixel format ("YUYV", "MJPG"), "" keeps its default.
+	// "raw" asks for YUYV frames as the camera sends them (CV_8UC2) instead of converted to BGR.
+	// Backends that ignore it deliver BGR, which the trackers take just the same; frames of any other
+	// type (such as the undecoded single-channel buffer V4L2 gives in OpenCV 3.x) fail the read.
+class CameraSource: public FrameSource {
+public:
+	VideoCapture cap;
+	bool badType;		// a frame of a type the trackers cannot read arrived (reported once)
 
-	printf("Final frameCount = %d \n", frameCount);
+	CameraSource (int index, string fourcc = "", bool raw = false) : cap(index) {
+		badType = false;
+		if (fourcc.size() == 4) {
+			cap.set(CV_CAP_PROP_FOURCC, CV_FOURCC(fourcc[0], fourcc[1], fourcc[2], fourcc[3]));
+		}
+		if (raw) {
+			cap.set(CV_CAP_PROP_CONVERT_RGB, 0);
+		}
+	}
+	bool isOpened () {
+		return cap.isOpened();
+	}
+	bool read (Mat &frame) {
+		cap >> frame;
+		if (frame.empty()) {
+			return false;
+		}
+		if (frame.type() != CV_8UC3 && frame.type() != CV_8UC2) {
+			if (!badType) {
+				printf("Camera delivers %d-channel frames of depth %d, neither BGR nor packed YUYV\n",
+						frame.channels(), frame.depth());
+				badType = true;
+			}
+			return false;
+		}
+		return true;
+	}
+	bool live () {
+		return true;
+	}
+	double fps () {
+		return cap.get(CV_CAP_PROP_FPS);
+	}
+};
+
+	// Recorded video file
+class VideoFileSource: public FrameSource {
+public:
+	VideoCapture cap;
+
+	VideoFileSource (string path) : cap(path) {}
+	bool isOpened () {
+		return cap.isOpened();
+	}
+	bool read (Mat &frame) {
+		cap >> frame;
+		return !frame.empty();
+	}
+	double fps () {
+		return cap.get(CV_CAP_PROP_FPS);
+	}
+};
+
+	// Numbered still images, e.g. "match1/cam1_%05d.png", read from index 0 until one is missing
+class ImageSequenceSource: public FrameSource {
+public:
+	string pattern;
+	bool valid;		// the pattern has exactly one integer conversion, so it is safe to format with
+	int index;
+
+	ImageSequenceSource (string set_pattern) {
+		pattern = set_pattern;
+		valid = checkPattern(pattern);
+		if (!valid) {
+			printf("Image pattern \"%s\" needs exactly one integer conversion such as %%05d (%%%% for a %%)\n",
+					pattern.c_str());
+		}
+		index = 0;
+	}
+
+	// Whether "pattern" takes exactly one int: one %d, %i or %u, with only flags, a width and a precision
+	// written out ("%05d"), and any other % doubled. The pattern comes from the command line and is
+	// used as a format string.
+	static bool checkPattern (string pattern) {
+		int conversions = 0;
+		for (size_t i = 0; i < pattern.size(); i++) {
+			if (pattern[i] != '%') {
+				continue;
+			}
+			if (++i < pattern.size() && pattern[i] == '%') {
+				continue;
+			}
+			while (i < pattern.size() && strchr("-+ #0", pattern[i]) != NULL) {
+				i++;
+			}
+			while (i < pattern.size() && (isdigit((unsigned char) pattern[i]) || pattern[i] == '.')) {
+				i++;
+			}
+			if (i >= pattern.size() || strchr("diu", pattern[i]) == NULL) {
+				return false;
+			}
+			conversions++;
+		}
+		return conversions == 1;
+	}
+
+	string fileName (int i) {
+		char name[512];
+		snprintf(name, sizeof(name), pattern.c_str(), i);
+		return name;
+	}
+	bool isOpened () {
+		return valid && !imread(fileName(index)).empty();
+	}
+	bool read (Mat &frame) {
+		if (!valid) {
+			return false;
+		}
+		Mat image = imread(fileName(index));
+		if (image.empty()) {
+			return false;
+		}
+		image.copyTo(frame);
+		index++;
+		return true;
+	}
+};
+
+	// Generator of moving coloured blobs: a red head and two yellow fists that sway and punch.
+	// Frame n only depends on the size, the player and n, so every run sees exactly the same frames.
+class SyntheticSource: public FrameSource {
+public:
+	int cols, rows;
+	int player;		// 1 or 2, gives each camera its own motion
+	double punchSpeed;	// 1 for the normal pace, higher for faster punches
+	int frameNo;
+
+	SyntheticSource (int set_cols, int set_rows, int set_player, double set_punchSpeed = 1.0) {
+		cols = set_cols;
+		rows = set_rows;
+		player = set_player;
+		punchSpeed = set_punchSpeed;
+		frameNo = 0;
+	}
+	bool isOpened () {
+		return cols > 0 && rows > 0;
+	}
+	bool read (Mat &frame) {
+		double t = frameNo*(player == 1 ? 0.05 : 0.043);
+		double punchL = max(0.0, sin(t*3.0*punchSpeed)), punchR = max(0.0, sin(t*3.0*punchSpeed + CV_PI));
+		int unit = rows/48;	// 10 pixels at 480p
+
+		frame.create(rows, cols, CV_8UC3);
+		frame.setTo(Scalar(40, 50, 40));
+
+		// Head sways around the lower middle of the frame
+		Point head((int) (cols/2 + 8*unit*sin(t)), (int) (rows*3/4 + 2*unit*cos(t*0.7)));
+		circle(frame, head, 5*unit, Scalar(60, 60, 220), -1);
+
+		// Fists start at the frame edges, where the hand ROIs start, and punch towards the centre
+		Point lFist((int) (cols/20 + punchL*cols/4), (int) (rows*3/4 - punchL*rows/4));
+		Point rFist((int) (cols*19/20 - punchR*cols/4), (int) (rows*3/4 - punchR*rows/4));
+		circle(frame, lFist, 3*unit, Scalar(40, 220, 220), -1);
+		circle(frame, rFist, 3*unit, Scalar(40, 220, 220), -1);
+
+		frameNo++;
+		return true;
+	}
+};
+
+	// Open a frame source from a command line spec:
+	//   cam:N  video:PATH  images:PATTERN  synthetic:WIDTHxHEIGHT[@PUNCHSPEED]
+	//   yuyv:N  camera N tracked on its packed YUYV frames, only the regions searched converted to BGR
+	//   mjpeg:N  camera N sending MJPEG, which needs less USB bandwidth at high resolutions and rates
+	// Returns NULL for an unknown spec.
+FrameSource *openSource (string spec, int player) {
+	size_t colon = spec.find(':');
+	string kind = spec.substr(0, colon);
+	string arg = colon == string::npos ? "" : spec.substr(colon + 1);
+
+	if (kind == "cam") {
+		return new CameraSource(atoi(arg.c_str()));
+	} else if (kind == "yuyv") {
+		return new CameraSource(atoi(arg.c_str()), "YUYV", true);
+	} else if (kind == "mjpeg") {
+		return new CameraSource(atoi(arg.c_str()), "MJPG");
+	} else if (kind == "video") {
+		return new VideoFileSource(arg);
+	} else if (kind == "images") {
+		return new ImageSequenceSource(arg);
+	} else if (kind == "synthetic") {
+		int w = 640, h = 480;
+		double speed = 1.0;
+		if (!arg.empty()) {
+			sscanf(arg.c_str(), "%dx%d@%lf", &w, &h, &speed);
+		}
+		return new SyntheticSource(w, h, player, speed);
+	}
+	return NULL;
+}
+
+	// Reads one camera on its own thread into a ring of preallocated frames,
+	// so that camera I/O overlaps tracking and rendering instead of adding to them
+class CaptureThread {
+public:
+	static const int ringSize = 3;	// newest frame + frame held by the game loop + frame being read
+	enum { retryMs = 10 };		// wait after a failed read before trying again
+	static const int maxFailures = 200;	// failed reads in a row (2 s) after which the camera is given up
+
+	FrameSource *source;
+	Mat ring[ringSize];
+	int64 stamps[ringSize];		// tick count when each frame was read
+	int newest;			// slot of the newest complete frame, -1 if none yet
+	int held;			// slot handed to the game loop, never written while held
+
+	// Counters
+	int64 framesRead;		// frames read from the camera
+	int64 framesTaken;		// frames taken by the game loop
+	int64 latencyTicks;		// sum of (taken - read) ticks
+	int64 failedReads;
+
+	mutex lock;
+	condition_variable firstFrame;
+	atomic<bool> running;
+	atomic<bool> failed;		// the camera stopped delivering and the thread gave up
+	thread worker;
+
+	CaptureThread () {
+		source = NULL;
+		newest = -1;
+		held = -1;
+		framesRead = 0;
+		framesTaken = 0;
+		latencyTicks = 0;
+		failedReads = 0;
+		running = false;
+		failed = false;
+	}
+	~CaptureThread () {
+		stop();
+	}
+
+	// Start reading "set_source", which must stay open until stop()
+	void start (FrameSource &set_source) {
+		source = &set_source;
+		running = true;
+		worker = thread(&CaptureThread::run, this);
+	}
+
+	void stop () {
+		{
+			lock_guard<mutex> guard(lock);
+			running = false;
+		}
+		firstFrame.notify_all();
+		if (worker.joinable()) {
+			worker.join();
+		}
+	}
+
+	// Block until the camera delivered its first frame (used once, to learn the frame size).
+	// False if it gave up before delivering one.
+	bool waitFirst () {
+		unique_lock<mutex> guard(lock);
+		while (newest < 0 && running) {
+			firstFrame.wait(guard);
+		}
+		return newest >= 0;
+	}
+
+	// Hand the newest frame and its timestamp to the game loop without blocking.
+	// Returns false if no frame arrived since the last call; "frame" is then the previous one.
+	bool latest (Mat &frame, int64 &stamp) {
+		lock_guard<mutex> guard(lock);
+		if (newest < 0 || newest == held) {
+			if (held >= 0) {
+				frame = ring[held];
+				stamp = stamps[held];
+			}
+			return false;
+		}
+		held = newest;
+		frame = ring[held];
+		stamp = stamps[held];
+		framesTaken++;
+		latencyTicks += getTickCount() - stamp;
+		return true;
+	}
+
+	void printStats (string name) {
+		printf("%-8s capture: %lld frames read, %lld used, %lld dropped, %.2f ms average age when used\n",
+				name.c_str(), (long long) framesRead, (long long) framesTaken,
+				(long long) (framesRead - framesTaken),
+				framesTaken ? latencyTicks*1000.0/getTickFrequency()/framesTaken : 0.0);
+		if (failedReads > 0) {
+			printf("%-8s capture: %lld failed reads%s\n", name.c_str(), (long long) failedReads,
+					failed ? ", camera given up" : "");
+		}
+	}
+
+private:
+	void run () {
+		int failures = 0;	// failed reads in a row
+		while (running) {
+			// Write into a slot that is neither the newest frame nor the one the game loop holds
+			int slot = 0;
+			{
+				lock_guard<mutex> guard(lock);
+				while (slot == newest || slot == held) {
+					slot++;
+				}
+			}
+
+			// reuses the slot's buffer once it has the camera's size
+			if (!source->read(ring[slot])) {
+				failedReads++;
+				if (++failures >= maxFailures) {
+					// Unplugged or never there: stop, and wake waitFirst()
+					lock_guard<mutex> guard(lock);
+					failed = true;
+					running = false;
+					break;
+				}
+				this_thread::sleep_for(chrono::milliseconds(retryMs));
+				continue;
+			}
+			failures = 0;
+			int64 stamp = getTickCount();
+
+			lock_guard<mutex> guard(lock);
+			stamps[slot] = stamp;
+			newest = slot;
+			framesRead++;
+			firstFrame.notify_all();
+		}
+		lock_guard<mutex> guard(lock);
+		firstFrame.notify_all();
+	}
+};
+
+	// Frame deadlines of one stream of frames (an arena): a frame is due once its slot begins,
+	// and frames that run past their budget are counted. The Engine sleeps until the earliest slot.
+class FramePacer {
+public:
+	enum Mode {
+		UNPACED,	// run as fast as possible
+		FIXED,		// aim for targetFps
+		CAMERA		// the loop waits for camera frames itself; only count frames that overrun the camera period
+	};
+	Mode mode;
+	double targetFps;
+	int64 period;		// frame budget, in ticks
+	int64 deadline;		// end of the current frame's budget
+	bool started;
+
+	// Counters
+	int64 frames;
+	int64 late;		// frames that ran past their budget
+	int64 dropped;		// whole frame slots skipped because of late frames (fixed mode)
+
+	FramePacer (Mode set_mode, double set_targetFps) {
+		mode = set_mode;
+		targetFps = set_targetFps;
+		if (mode != UNPACED && targetFps <= 0.0) {
+			targetFps = 30.0; // camera did not report its rate
+		}
+		period = mode == UNPACED ? 0 : (int64) (getTickFrequency()/targetFps);
+		deadline = 0;
+		started = false;
+		frames = late = dropped = 0;
+	}
+
+	// Call when a new frame starts being processed
+	void begin () {
+		if (mode == CAMERA || (mode == FIXED && !started)) {
+			deadline = getTickCount() + period;
+			started = true;
+		}
+	}
+
+	// Whether the next frame may start at "now": in fixed mode not before its slot begins
+	bool due (int64 now) const {
+		return mode != FIXED || !started || now >= deadline - period;
+	}
+
+	// When the next frame's slot begins, 0 if it does not wait for one
+	int64 wakeAt () const {
+		return mode == FIXED && started ? deadline - period : 0;
+	}
+
+	// Call once at the end of each frame: count it, note whether it was late and move to the
+	// next slot. Returns the ticks left of its budget.
+	int64 finish () {
+		int64 now = getTickCount();
+
+		frames++;
+		if (mode != UNPACED && now > deadline) {
+			late++;
+			if (mode == FIXED) {
+				// The frame slots this frame ran into are lost
+				int64 missed = (now - deadline)/period;
+				dropped += missed;
+				deadline += (missed + 1)*period;
+				return 0;
+			}
+		}
+
+		if (mode == FIXED) {
+			int64 left = deadline - now;
+			deadline += period;
+			return left;
+		}
+		return 0;
+	}
+
+	void printStats () {
+		const char *names[] = { "unpaced", "fixed", "camera" };
+		printf("Pacing (%s, %.1f FPS target): %lld frames, %lld late, %lld frame slots dropped\n",
+				names[mode], mode == UNPACED ? 0.0 : targetFps, (long long) frames,
+				(long long) late, (long long) dropped);
+	}
+};
+
+	// Small fixed pool of worker threads. Tasks are queued with submit();
+	// wait() is the barrier that returns once every submitted task has finished.
+class WorkerPool {
+public:
+	vector<thread> workers;
+	vector<const function<void()> *> tasks;	// tasks of the current round, in order
+	size_t next;			// first task not yet taken by a worker
+	int pending;			// tasks submitted but not finished
+	bool quit;
+	mutex lock;
+	condition_variable workReady, allDone;
+
+	WorkerPool (int nWorkers) {
+		next = 0;
+		pending = 0;
+		quit = false;
+		for (int i = 0; i < nWorkers; i++) {
+			workers.push_back(thread(&WorkerPool::run, this));
+		}
+	}
+	~WorkerPool () {
+		{
+			lock_guard<mutex> guard(lock);
+			quit = true;
+		}
+		workReady.notify_all();
+		for (size_t i = 0; i < workers.size(); i++) {
+			workers[i].join();
+		}
+	}
+
+	// "task" is not copied and must stay alive until wait() returns; tasks built once
+	// before the game loop are submitted every frame without allocating
+	void submit (const function<void()> &task) {
+		{
+			lock_guard<mutex> guard(lock);
+			tasks.push_back(&task);
+			pending++;
+		}
+		workReady.notify_one();
+	}
+
+	void wait () {
+		unique_lock<mutex> guard(lock);
+		while (pending > 0) {
+			allDone.wait(guard);
+		}
+		tasks.clear(); // keeps its capacity for the next round
+		next = 0;
+	}
+
+private:
+	void run () {
+		while (true) {
+			const function<void()> *task;
+			{
+				unique_lock<mutex> guard(lock);
+				while (next == tasks.size() && !quit) {
+					workReady.wait(guard);
+				}
+				if (next == tasks.size()) {
+					return;
+				}
+				task = tasks[next++];
+			}
+
+			(*task)();
+
+			lock_guard<mutex> guard(lock);
+			if (--pending == 0) {
+				allDone.notify_all();
+			}
+		}
+	}
+};
+
+	// How a game window shows the scene: player 1's window as laid out, player 2's turned by 180 degrees.
+	// Drawing through it puts each view straight into its own buffer, at the pixels flip(-1) would move them to.
+struct ViewTransform {
+	int cols, rows;
+	bool rotated;
+
+	ViewTransform (int set_cols, int set_rows, bool set_rotated) {
+		cols = set_cols;
+		rows = set_rows;
+		rotated = set_rotated;
+	}
+
+	Point operator() (Point p) const {
+		return rotated ? Point(cols - 1 - p.x, rows - 1 - p.y) : p;
+	}
+
+	Rect operator() (Rect r) const {
+		return rotated ? Rect(cols - r.x - r.width, rows - r.y - r.height, r.width, r.height) : r;
+	}
+
+	// Degrees to add to the angle of an ellipse
+	double angle () const {
+		return rotated ? 180 : 0;
+	}
+};
+
+	// Per-frame physics state of the six trackers of a match (COM, ROI, radius, touch flag), kept as
+	// one array per field so that separation and hit detection run over a few cache lines
+	// instead of copying whole moTracker objects around
+struct Physics {
+	enum { P1, P1L, P1R, P2, P2L, P2R, N };	// head, left and right fist of each player
+
+	int xCOM[N], yCOM[N];			// coordinates of Centre of Mass
+	int xROI[N], yROI[N], wROI[N], hROI[N];	// ROI's dimensions
+	int rad[N];				// radius of the drawn head or fist
+	bool isTouching[N];			// fist is touching the other player's head
+	bool separateOwn;			// keep each player's own head and fists apart
+						// (not needed when blob tracking tells the fists apart)
+
+	Physics () {
+		separateOwn = true;
+	}
+
+	// One pair of trackers to keep apart
+	struct Contact {
+		int moved, ref;		// tracker "moved" is pushed out of tracker "ref"
+		int rDist;		// sum of their radii
+		bool cross;		// "ref" belongs to the other player, whose camera sees the scene rotated by 180 degrees
+		bool hit;		// fist against head: decides isTouching of "moved"
+	};
+	// Contacts are resolved in stages: each player's fists out of their own head, then out of each
+	// other, then the two players' fists, then the hits. Each stage is built from the COMs as the
+	// stages before it left them, because which tracker gives way depends on where they ended up.
+	enum { OWN1, FISTS1, OWN2, FISTS2, CROSS, HITS, stages };
+	enum { maxContacts = 4 };	// most contacts in one stage
+
+	// The head/fist pairs of "stage", in the order they are resolved. Returns how many.
+	int contacts (Contact out[], int rows, int stage) const {
+		int n = 0;
+		int r1Head = rad[P1], r1Hand = rad[P1R];
+		int r2Head = rad[P2], r2Hand = rad[P2R];
+		int p = stage == OWN1 || stage == FISTS1 ? P1 : P2;
+		int headRad = rad[p], handRad = rad[p + 2];
+
+		switch (stage) {
+		case OWN1:
+		case OWN2:
+			if (separateOwn) {
+				out[n++] = contact(p + 1, p, headRad + handRad, false, false);
+				out[n++] = contact(p + 2, p, headRad + handRad, false, false);
+			}
+			break;
+		case FISTS1:
+		case FISTS2:
+			// Which fist gives way depends on whether the left fist is now drawn left of the head
+			// (player 2 is drawn upside down)
+			if (separateOwn) {
+				bool leftOfHead = p == P1 ? xCOM[p + 1] + handRad < xCOM[p] : xCOM[p] + handRad < xCOM[p + 1];
+				if (leftOfHead) {
+					out[n++] = contact(p + 2, p + 1, 2*handRad, false, false);
+				} else {
+					out[n++] = contact(p + 1, p + 2, 2*handRad, false, false);
+				}
+			}
+			break;
+		case CROSS: {
+			// Separate the two players' fists: the fists of the player in the upper half give way
+			int mover = yCOM[P1L] - r1Hand >= rows/2 ? P2 : P1;
+			int other = mover == P1 ? P2 : P1;
+			out[n++] = contact(mover + 1, other + 1, r1Hand + r2Hand, true, false);
+			out[n++] = contact(mover + 2, other + 1, r1Hand + r2Hand, true, false);
+			out[n++] = contact(mover + 1, other + 2, r1Hand + r2Hand, true, false);
+			out[n++] = contact(mover + 2, other + 2, r1Hand + r2Hand, true, false);
+			break;
+		}
+		case HITS:
+			// Fists against the other player's head decide the hits
+			out[n++] = contact(P2L, P1, r1Head + r2Hand, true, true);
+			out[n++] = contact(P2R, P1, r1Head + r2Hand, true, true);
+			out[n++] = contact(P1L, P2, r2Head + r1Hand, true, true);
+			out[n++] = contact(P1R, P2, r2Head + r1Hand, true, true);
+			break;
+		}
+		return n;
+	}
+
+	static Contact contact (int moved, int ref, int rDist, bool cross, bool hit) {
+		Contact c;
+		c.moved = moved;
+		c.ref = ref;
+		c.rDist = rDist;
+		c.cross = cross;
+		c.hit = hit;
+		return c;
+	}
+
+	// Push tracker c.moved out of c.ref until their centres are c.rDist apart, along the line
+	// between them; no trigonometry, and the distance is only compared squared.
+	// Distances are rounded to whole pixels before comparing, as the game always did.
+	void resolve (const Contact &c, int cols, int rows) {
+		int i = c.moved;
+		int64 bx = xCOM[c.ref], by = yCOM[c.ref];
+		if (c.cross) {
+			// the other player's tracker, seen from this player's camera
+			bx = cols - bx;
+			by = rows - by;
+		}
+		int64 dx = xCOM[i] - bx, dy = yCOM[i] - by;
+		int64 d2 = dx*dx + dy*dy;
+		int64 rDist = c.rDist;
+
+		// round(dist) < rDist  <=>  d2 <= rDist^2 - rDist
+		if (d2 <= rDist*rDist - rDist) {
+			if (d2 == 0) {
+				// Coincident centres have no direction: push back towards the player's own side
+				xCOM[i] = (int) bx;
+				yCOM[i] = (int) (by + rDist);
+			} else {
+				double scale = rDist/sqrt((double) d2);
+				xCOM[i] = (int) (bx + dx*scale);
+				yCOM[i] = (int) (by + dy*scale);
+			}
+		}
+
+		if (c.hit) {
+			// round(dist) > a  <=>  d2 > a^2 + a,   round(dist) < b  <=>  d2 <= b^2 - b
+			int64 near = rDist - 10, far = rDist + 10, apart = rDist + 30;
+			if ((near < 0 || d2 > near*near + near) && d2 <= far*far - far) {
+				isTouching[i] = true;	// fist is touching head
+			} else if (d2 > apart*apart + apart) {
+				isTouching[i] = false;	// fist parts from head
+			}
+		}
+	}
+
+	// Keep every head and fist of both players apart and decide the hits, stage by stage
+	void resolveCollisions (int cols, int rows) {
+		Contact c[maxContacts];
+		for (int stage = 0; stage < stages; stage++) {
+			int n = contacts(c, rows, stage);
+			for (int k = 0; k < n; k++) {
+				resolve(c[k], cols, rows);
+			}
+		}
+	}
+};
+
+#ifdef BOXING_INSTRUMENT
+	// Hot-path counters, built in only with -DBOXING_INSTRUMENT (INSTRUMENT in the Makefile).
+	// Every probe goes through PROBE() or PROBE_METHOD(), which are empty otherwise.
+	// Counters add up over a period of frames; at its end they become per-frame averages that
+	// the overlay shows and that are appended to the dump, one CSV or JSON line per period.
+	// Each tracker's counters are only written by the thread tracking its player. With several arenas
+	// only the trackers of the watched Physics block (the first arena's) are counted.
+class Instruments {
+public:
+	enum Method { FEED, SEARCH, COARSE, PREDICT, UPDATE_ROI, DRAW_ROI, METHODS };
+
+	struct Counters {
+		int64 pixels;		// pixels scanned for the colour
+		int64 mass;		// pixels of the colour found
+		double jitter;		// sum of |COM - 2 COM' + COM''|, which is 0 for steady motion
+		int64 ticks[METHODS];
+		int64 calls[METHODS];
+	};
+	Counters trackers[Physics::N];
+	int xLast[Physics::N][2], yLast[Physics::N][2];	// the previous two COMs
+	int samples[Physics::N];
+	int64 ageTicks[2];	// how old each camera's frame was when tracking started
+	int64 renderTicks;
+	int frames;
+
+	// Per-frame averages of the last complete period
+	struct Summary {
+		double pixels, mass, jitter;
+		double ms[METHODS];	// per call
+	};
+	Summary last[Physics::N];
+	double ageMs[2], renderMs;
+	int lastFrame;		// frame that completed the last period, -1 before the first
+
+	int period;		// frames per period
+	FILE *dump;
+	bool json;
+	const Physics *watched;	// trackers counted, NULL for none
+
+	Instruments () {
+		watched = NULL;
+		memset(trackers, 0, sizeof(trackers));
+		memset(samples, 0, sizeof(samples));
+		memset(last, 0, sizeof(last));
+		ageTicks[0] = ageTicks[1] = 0;
+		renderTicks = 0;
+		frames = 0;
+		ageMs[0] = ageMs[1] = renderMs = 0.0;
+		lastFrame = -1;
+		period = 30;
+		dump = NULL;
+		json = false;
+	}
+
+	// Dump each period to "path": JSON lines if it ends in .json, CSV otherwise
+	bool openDump (string path) {
+		dump = fopen(path.c_str(), "w");
+		json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+		if (dump != NULL && !json) {
+			fprintf(dump, "frame,tracker,pixels,mass,jitter,feed_ms,search_ms,coarse_ms,predict_ms,"
+					"update_roi_ms,draw_roi_ms,camera_age_ms,render_ms\n");
+		}
+		return dump != NULL;
+	}
+
+	void closeDump () {
+		if (dump != NULL) {
+			fclose(dump);
+			dump = NULL;
+		}
+	}
+
+	// Pixels a tracker scanned for its colour
+	void scanned (const Physics *ph, int id, int64 pixels) {
+		if (ph == watched) {
+			trackers[id].pixels += pixels;
+		}
+	}
+
+	// The COM a tracker settled on this frame and how much of its colour it found
+	void sample (const Physics *ph, int id, int x, int y, int64 mass) {
+		if (ph != watched) {
+			return;
+		}
+		trackers[id].mass += mass;
+		if (samples[id] >= 2) {
+			trackers[id].jitter += abs(x - 2*xLast[id][0] + xLast[id][1]) + abs(y - 2*yLast[id][0] + yLast[id][1]);
+		}
+		xLast[id][1] = xLast[id][0];
+		yLast[id][1] = yLast[id][0];
+		xLast[id][0] = x;
+		yLast[id][0] = y;
+		samples[id]++;
+	}
+
+	// Time a tracker spent on colour search outside feedNewframe, counted as a feedNewframe call
+	void fed (const Physics *ph, int id, int64 ticks) {
+		if (ph == watched) {
+			trackers[id].ticks[FEED] += ticks;
+			trackers[id].calls[FEED]++;
+		}
+	}
+
+	void cameraAge (int camera, int64 stamp) {
+		if (stamp > 0) {
+			ageTicks[camera] += getTickCount() - stamp;
+		}
+	}
+
+	// Called by the game loop once per frame, after the workers are done
+	void endFrame (int frameNo) {
+		if (++frames < period) {
+			return;
+		}
+		double msPerTick = 1000.0/getTickFrequency();
+		for (int i = 0; i < Physics::N; i++) {
+			Counters &c = trackers[i];
+			last[i].pixels = (double) c.pixels/frames;
+			last[i].mass = (double) c.mass/frames;
+			last[i].jitter = c.jitter/frames;
+			for (int m = 0; m < METHODS; m++) {
+				last[i].ms[m] = c.calls[m] ? c.ticks[m]*msPerTick/c.calls[m] : 0.0;
+			}
+		}
+		ageMs[0] = ageTicks[0]*msPerTick/frames;
+		ageMs[1] = ageTicks[1]*msPerTick/frames;
+		renderMs = renderTicks*msPerTick/frames;
+		lastFrame = frameNo;
+		if (dump != NULL) {
+			writeDump();
+		}
+
+		memset(trackers, 0, sizeof(trackers));
+		ageTicks[0] = ageTicks[1] = 0;
+		renderTicks = 0;
+		frames = 0;
+	}
+
+	// The last period's numbers of one player's trackers, top left of that player's ROI window
+	void drawOverlay (Mat frame, int player) {
+		static const char *names[] = { "head", "left", "right" };
+		char line[128];
+		int y = 20;
+		if (lastFrame < 0) {
+			return;
+		}
+		for (int k = 0; k < 3; k++) {
+			const Summary &t = last[3*player + k];
+			snprintf(line, sizeof(line), "%-5s %6.0f px %5.0f mass jit %4.1f feed %.3f ms",
+					names[k], t.pixels, t.mass, t.jitter, t.ms[FEED]);
+			putText(frame, line, Point(10, y), FONT_HERSHEY_PLAIN, 1, Scalar(255,255,255), 1, 8);
+			y += 18;
+		}
+		snprintf(line, sizeof(line), "camera age %.2f ms  render %.2f ms", ageMs[player], renderMs);
+		putText(frame, line, Point(10, y), FONT_HERSHEY_PLAIN, 1, Scalar(255,255,255), 1, 8);
+	}
+
+private:
+	void writeDump () {
+		static const char *names[] = { "p1", "p1LHand", "p1RHand", "p2", "p2LHand", "p2RHand" };
+		if (json) {
+			fprintf(dump, "{\"frame\": %d, \"camera_age_ms\": [%.3f, %.3f], \"render_ms\": %.3f, \"trackers\": [",
+					lastFrame, ageMs[0], ageMs[1], renderMs);
+		}
+		for (int i = 0; i < Physics::N; i++) {
+			const Summary &t = last[i];
+			if (json) {
+				fprintf(dump, "%s{\"name\": \"%s\", \"pixels\": %.0f, \"mass\": %.0f, \"jitter\": %.3f, "
+						"\"feed_ms\": %.4f, \"search_ms\": %.4f, \"coarse_ms\": %.4f, \"predict_ms\": %.4f, "
+						"\"update_roi_ms\": %.4f, \"draw_roi_ms\": %.4f}", i ? ", " : "", names[i],
+						t.pixels, t.mass, t.jitter, t.ms[FEED], t.ms[SEARCH], t.ms[COARSE], t.ms[PREDICT],
+						t.ms[UPDATE_ROI], t.ms[DRAW_ROI]);
+			} else {
+				fprintf(dump, "%d,%s,%.0f,%.0f,%.3f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.3f,%.3f\n", lastFrame, names[i],
+						t.pixels, t.mass, t.jitter, t.ms[FEED], t.ms[SEARCH], t.ms[COARSE], t.ms[PREDICT],
+						t.ms[UPDATE_ROI], t.ms[DRAW_ROI], ageMs[i/3], renderMs);
+			}
+		}
+		if (json) {
+			fprintf(dump, "]}\n");
+		}
+		fflush(dump);
+	}
+};
+
+Instruments instruments;
+
+	// Adds the ticks of its scope to one method of one tracker, if that tracker is watched
+struct MethodProbe {
+	int64 start;
+	Instruments::Counters *counters;
+	int method;
+
+	MethodProbe (const Physics *ph, int id, int set_method) {
+		counters = ph == instruments.watched ? &instruments.trackers[id] : NULL;
+		method = set_method;
+		start = counters ? getTickCount() : 0;
+	}
+	~MethodProbe () {
+		if (counters != NULL) {
+			counters->ticks[method] += getTickCount() - start;
+			counters->calls[method]++;
+		}
+	}
+};
+
+#define PROBE(statement) statement
+#define PROBE_METHOD(ph, id, method) MethodProbe methodProbe(ph, id, Instruments::method)
+#else
+#define PROBE(statement)
+#define PROBE_METHOD(ph, id, method)
+#endif
+
+	// Class for Motion Trackers
+class moTracker: public ScreenObs {
+public:
+	// ROI Attributes
+	// ROI's dimensions, Centre of Mass and touch flag live in the match's Physics block
+	Physics *ph;
+	int id;				// this tracker's index in *ph
+	bool firstRun; 			// check whether it is the first time the programme runs
+
+	int topLim, leftLim, botLim, rLim; 	// ROI can only move within this region
+	bool limSet; 				// are specific limits set for ROI?
+
+	// Attributes of a player (drawing and stamina only; tracking reads the Physics block)
+	int xHead, yHead, headRad; 			// head set
+	int xlHand, ylHand, handRad, xrHand, yrHand; 	// hand set
+	int p2Factor; 					// applied in calculation depends on which player is using function
+	bool player2; 					// check if the ROI belongs to player 2
+	bool hit;
+	int hitNo;
+	int hitsTaken;	// every hit of the match, including those stamina has recovered from
+	int xlEye;
+	int xrEye;
+	int yEye;
+	vector<Point> smileArc;				// outline of the smile, reused every frame
+
+	// Stamina bar attributes
+	int xBar, yBar, wBar, hBar, maxStat;
+	int xBox, yBox, wBox, hBox;
+	int countFrame;
+	int recoveryFrames;	// frames without a hit that take one hit off
+
+	// Predictive search: a constant-velocity (alpha-beta) estimate of where the colour is on the camera
+	bool predictive;	// search around the prediction instead of inside the ROI
+	double xEst, yEst;	// filtered position, camera pixels
+	double xVel, yVel;	// filtered velocity, pixels per frame
+	Rect searchWindow;	// last window searched
+
+	// Coarse-to-fine search: 0 scans the ROI at full resolution, n > 0 finds the COM on pyramid level n
+	// over twice the ROI and refines it at full resolution around the object
+	int pyramidLevel;
+
+	bool blobs;		// COM comes from the camera's shared blob labelling (see trackBlobs)
+
+	// Timing counters
+	bool fused;		// threshold and sum in one pass with bandMoments, without a mask
+	bool roiOnly;		// threshold only the ROI instead of the whole frame (mask path)
+	bool labelled;		// read the camera's colour-class labels, when the band is one of the classes
+	int64 feedTicks;	// ticks spent inside feedNewframe
+	int feedCalls;		// number of feedNewframe calls
+	int64 pixelsThresholded;	// pixels the colour search read: thresholded, or downsampled by the coarse pass
+	int64 lostFrames;	// frames in which none of the colour was found
+	int64 widenings;	// predictive searches repeated with a wider window
+
+	moTracker (Physics &set_ph, int set_id) {
+		ph = &set_ph;
+		id = set_id;
+
+		// default setROI
+		xROI() = 100;
+		yROI() = 200;
+		wROI() = 50;
+		hROI() = 50;
+		xCOM() = xROI() + wROI()/2;
+		yCOM() = yROI() + hROI()/2;
+		ph->rad[id] = wROI()/2;
+
+		hBar = 30;
+		maxStat = 160;
+
+		//loop check
+		firstRun = true; // by default loop has to go through first run
+		limSet = false;  // by default no limits are set
+		p2Factor = 1;
+		player2 = false;
+		isTouching() = false;
+		hit = false;
+		hitNo = 0;
+		hitsTaken = 0;
+		countFrame = 0;
+		recoveryFrames = 100;
+		headRad = handRad = 0;
+
+		predictive = false;
+		xEst = yEst = 0.0;
+		xVel = yVel = 0.0;
+		pyramidLevel = 0;
+		blobs = false;
+
+		fused = true;
+		roiOnly = true;
+		labelled = false;
+		feedTicks = 0;
+		feedCalls = 0;
+		pixelsThresholded = 0;
+		lostFrames = 0;
+		widenings = 0;
+	}
+	// Hot state, stored in the Physics block
+	int &xCOM () { return ph->xCOM[id]; }
+	int &yCOM () { return ph->yCOM[id]; }
+	int &xROI () { return ph->xROI[id]; }
+	int &yROI () { return ph->yROI[id]; }
+	int &wROI () { return ph->wROI[id]; }
+	int &hROI () { return ph->hROI[id]; }
+	bool &isTouching () { return ph->isTouching[id]; }
+	int xCOM () const { return ph->xCOM[id]; }
+	int yCOM () const { return ph->yCOM[id]; }
+	int wROI () const { return ph->wROI[id]; }
+	bool isTouching () const { return ph->isTouching[id]; }
+
+	void feedNewframe (Mat frame, Scalar darker, Scalar brighter, CameraCache &camera, int frameNo) {
+		PROBE_METHOD(ph, id, FEED);
+
+		// brightness of each pixel - on x,y-axis and the sum
+		ComMoments mom;
+
+		int64 start = getTickCount();
+
+		prepare(frame);
+
+		if (pyramidLevel > 0) {
+			mom = coarseToFine(frame, darker, brighter, camera.masks, camera.pyramid, frameNo);
+		} else if (predictive) {
+			mom = predictAndSearch(frame, darker, brighter, camera.masks, frameNo);
+		} else {
+			Rect window = Rect(xROI(), yROI(), wROI(), hROI()) & Rect(0, 0, frame.cols, frame.rows);
+			mom = searchColour(frame, window, darker, brighter, camera.masks, frameNo);
+		}
+
+	// Compute COM
+		if (mom.sMass != 0) {
+			xCOM() = (int) (mom.xMass/mom.sMass);
+			yCOM() = (int) (mom.yMass/mom.sMass);
+		} else {
+			lostFrames++;
+		}
+		PROBE(instruments.sample(ph, id, xCOM(), yCOM(), mom.sMass/255));
+
+		feedTicks += getTickCount() - start;
+		feedCalls++;
+	}
+
+	// Set up what depends on the first frame
+	void prepare (Mat frame) {
+		if (firstRun) { // if this is the 1st Run!
+			xCOM() = xROI() + wROI()/2;
+			yCOM() = yROI() + hROI()/2;
+			
+			// Set up stamina bar
+			if (player2) {
+				xBar = (int)(frame.cols*1/16);
+				yBar = (int)(frame.rows*1/16);
+			} else {
+				xBar = (int)(frame.cols*11/16);
+				yBar = (int)(frame.rows*14/16);
+			}
+			wBar = maxStat;
+			xBox = xBar - 5;
+			yBox = yBar - 5;
+			wBox = wBar + 10;
+			hBox = hBar + 10;
+			xEst = xCOM();
+			yEst = yCOM();
+			firstRun = false; // 1st run is over
+		}
+	}
+
+	// Where the tracked colour should be on this frame: the constant-velocity prediction,
+	// or where it was last seen
+	Point2d predicted () const {
+		if (predictive) {
+			return Point2d(xEst + xVel, yEst + yVel);
+		}
+		return Point2d(xCOM(), yCOM());
+	}
+
+	// Feed a measured position to the constant-velocity estimate
+	void observe (double x, double y) {
+		const double alpha = 0.85, beta = 0.5;	// how far position and velocity follow each measurement
+		Point2d pred = predicted();
+		double xRes = x - pred.x, yRes = y - pred.y;
+		xEst = pred.x + alpha*xRes;
+		yEst = pred.y + alpha*yRes;
+		xVel += beta*xRes;
+		yVel += beta*yRes;
+	}
+
+	// Region of the camera frame this tracker can find its colour in this frame:
+	// twice its ROI around where it should be, inside its limits
+	Rect reach (Mat frame) {
+		Point2d pred = predicted();
+		Rect bounds = Rect(0, 0, frame.cols, frame.rows);
+		if (limSet) {
+			bounds &= Rect(leftLim, topLim, rLim - leftLim, botLim - topLim);
+		}
+		return Rect(cvRound(pred.x) - wROI(), cvRound(pred.y) - hROI(), 2*wROI(), 2*hROI()) & bounds;
+	}
+
+	// Count colour search work done outside feedNewframe (blob tracking) as if it were a call of it
+	void chargeFeed (int64 ticks, int64 pixels) {
+		feedTicks += ticks;
+		feedCalls++;
+		pixelsThresholded += pixels;
+		PROBE(instruments.scanned(ph, id, pixels));
+		PROBE(instruments.fed(ph, id, ticks));
+	}
+
+	// Take the COM of the component assigned to this tracker, NULL if none was
+	void takeBlob (const Blob *blob) {
+		if (blob == NULL) {
+			lostFrames++;
+			xVel = yVel = 0.0;
+			return;
+		}
+		if (predictive) {
+			observe(blob->x, blob->y);
+		}
+		xCOM() = (int) blob->x;
+		yCOM() = (int) blob->y;
+		PROBE(instruments.sample(ph, id, xCOM(), yCOM(), blob->area));
+	}
+
+	// Moments of the pixels of "window" inside the colour band
+	ComMoments searchColour (Mat frame, Rect window, Scalar darker, Scalar brighter, MaskCache &masks, int frameNo) {
+		PROBE_METHOD(ph, id, SEARCH);
+		int bit = labelled ? masks.classes.bit(darker, brighter) : 0;
+		if (bit != 0) {
+			// Every class of the search region is labelled in one pass shared by all trackers of the frame
+			Rect search = roiOnly ? window : Rect(0, 0, frame.cols, frame.rows);
+			const Mat &labels = masks.labels(masks.colour(frame, frameNo, search), frameNo, search);
+			pixelsThresholded += search.area();
+			PROBE(instruments.scanned(ph, id, search.area()));
+			return labelMoments(labels, window, bit);
+		}
+		if (fused) {
+			// Test the window's pixels against the colour band and sum the COM in the same pass
+			pixelsThresholded += window.area();
+			PROBE(instruments.scanned(ph, id, window.area()));
+			return bandMoments(masks.colour(frame, frameNo, window), window, darker, brighter);
+		}
+
+		// Only the window is read below, so only the window needs thresholding
+		Rect search = window;
+		if (!roiOnly) {
+			search = Rect(0, 0, frame.cols, frame.rows);
+		}
+
+		// Color detection that detects only the color between the "darker" and "brighter" threshold,
+		// on "colorOutput" Mat, the specific color becomes white, others becomes black background.
+		// Trackers of the same frame and colour share one mask through "masks".
+		const Mat &colorOutput = masks.mask(masks.colour(frame, frameNo, search), frameNo, darker, brighter, search);
+		pixelsThresholded += search.area();
+		PROBE(instruments.scanned(ph, id, search.area()));
+		return maskMoments(colorOutput, window);
+	}
+
+	// Find the object on a pyramid level of twice the ROI: downsampling reads those pixels once
+	// (plus a third for the levels in between) and the search 4/4^n of the ROI's pixels.
+	// Then take its COM at full resolution from a window just big enough for an object of that mass.
+	// The coarse pass always uses the fused kernel; the fine pass uses this tracker's colour path.
+	ComMoments coarseToFine (Mat frame, Scalar darker, Scalar brighter, MaskCache &masks,
+			FramePyramid &pyramid, int frameNo) {
+		PROBE_METHOD(ph, id, COARSE);
+		int level = min(pyramidLevel, (int) FramePyramid::maxLevel);
+		int scale = 1 << level;
+		ComMoments mom;
+
+		Rect wide = Rect(xROI() - wROI()/2, yROI() - hROI()/2, 2*wROI(), 2*hROI()) & Rect(0, 0, frame.cols, frame.rows);
+		searchWindow = wide;
+		int64 downsampled;
+		const Mat &coarse = pyramid.level(masks.colour(frame, frameNo, wide), wide, level, downsampled);
+		Rect window = Rect(0, 0, coarse.cols, coarse.rows);
+		mom = bandMoments(coarse, window, darker, brighter);
+		pixelsThresholded += downsampled + window.area();
+		PROBE(instruments.scanned(ph, id, downsampled + window.area()));
+		if (mom.sMass == 0) {
+			return mom;
+		}
+
+		// Centre of the coarse COM's pixel at full resolution, and the radius of a round object
+		// of the mass found (each coarse pixel stands for scale x scale full-resolution ones)
+		int xCoarse = wide.x + (int) (mom.xMass/mom.sMass)*scale + scale/2;
+		int yCoarse = wide.y + (int) (mom.yMass/mom.sMass)*scale + scale/2;
+		double area = (double) (mom.sMass/255)*scale*scale;
+		int half = min((int) sqrt(area/CV_PI) + 2*scale, max(wROI(), hROI()));
+
+		Rect fine = Rect(xCoarse - half, yCoarse - half, 2*half + 1, 2*half + 1) & Rect(0, 0, frame.cols, frame.rows);
+		ComMoments refined = searchColour(frame, fine, darker, brighter, masks, frameNo);
+		if (refined.sMass == 0) {
+			// The object is only there in blurred form: go with the coarse position
+			refined.sMass = 255;
+			refined.xMass = 255*(int64) xCoarse;
+			refined.yMass = 255*(int64) yCoarse;
+		}
+		return refined;
+	}
+
+	// Search a window smaller than the ROI, centred where the object should be if it kept its velocity.
+	// Only when none of the colour is found there is the window widened and searched again, so a fast
+	// punch costs a few extra pixels on the frames it is lost instead of a bigger ROI on every frame.
+	ComMoments predictAndSearch (Mat frame, Scalar darker, Scalar brighter, MaskCache &masks, int frameNo) {
+		PROBE_METHOD(ph, id, PREDICT);
+		const int maxWidenings = 3;		// 3/4, 3/2, 3 and 6 times the ROI size
+		Rect bounds = Rect(0, 0, frame.cols, frame.rows);
+		ComMoments mom;
+
+		if (limSet) {
+			bounds &= Rect(leftLim, topLim, rLim - leftLim, botLim - topLim);
+		}
+
+		Point2d pred = predicted();
+		int w = wROI()*3/4, h = hROI()*3/4;
+		for (int widen = 0; ; widen++) {
+			searchWindow = Rect(cvRound(pred.x) - w/2, cvRound(pred.y) - h/2, w, h) & bounds;
+			mom = searchColour(frame, searchWindow, darker, brighter, masks, frameNo);
+			if (mom.sMass != 0 || widen == maxWidenings || searchWindow == bounds) {
+				break;
+			}
+			w *= 2;
+			h *= 2;
+			widenings++;
+		}
+
+		if (mom.sMass != 0) {
+			observe((double) mom.xMass/mom.sMass, (double) mom.yMass/mom.sMass);
+		} else {
+			// Lost: wait where it was last seen
+			xVel = yVel = 0.0;
+		}
+		return mom;
+	}
+
+	// Average time spent in feedNewframe, in milliseconds
+	double feedTime () {
+		if (feedCalls == 0) {
+			return 0.0;
+		}
+		return (double) feedTicks*1000.0/getTickFrequency()/feedCalls;
+	}
+
+	// Print the timing counters of this tracker
+	void printTiming (string name) {
+		char pyramidNote[32] = "";
+		if (pyramidLevel > 0) {
+			snprintf(pyramidNote, sizeof(pyramidNote), ", pyramid level %d", pyramidLevel);
+		}
+		printf("%-8s feedNewframe: %.3f ms/call, %lld pixels requested/call (%s%s), lost on %lld frames\n",
+				name.c_str(), feedTime(),
+				feedCalls ? (long long) (pixelsThresholded/feedCalls) : 0LL,
+				labelled ? (roiOnly ? "ROI labels" : "full-frame labels") : fused ? "fused kernel"
+				: roiOnly ? "ROI mask" : "full-frame mask",
+				pyramidLevel > 0 ? pyramidNote : predictive ? ", predictive" : "", (long long) lostFrames);
+	}
+	
+	// Conditions for ROI location
+	void updateROI (Mat frame) {
+		PROBE_METHOD(ph, id, UPDATE_ROI);
+		xROI() = xCOM() - wROI()/2;
+		yROI() = yCOM() - hROI()/2;
+
+		// Keeping the tracker inside boundaries
+			if (limSet == false) {
+				//default setLim
+				topLim = 0;
+				leftLim = 0;
+				botLim = frame.rows;
+				rLim = frame.cols;
+			}
+			if (xROI() < leftLim) {
+				xROI() = leftLim;
+			}
+			if (xROI() + wROI() > rLim) {
+				xROI() = rLim - wROI();
+			}
+			if (yROI() < topLim) {
+				yROI() = topLim;
+			}
+			if (yROI() + hROI() > botLim) {
+				yROI() = botLim - hROI();
+			}
+	}
+	
+	// Draw ROI on frame
+	void drawROI (Mat frame) {
+		PROBE_METHOD(ph, id, DRAW_ROI);
+		rectangle (frame, Rect(xROI(), yROI(), wROI(), hROI()), obColour, 2);
+		if (predictive || pyramidLevel > 0 || blobs) {
+			rectangle (frame, searchWindow, obColour, 1);
+		}
+	}
+
+	// Customise ROI attributes
+	void setROI (int set_xROI, int set_yROI, int set_wROI,
+			int set_hROI) {
+		xROI() = set_xROI;
+		yROI() = set_yROI;
+		wROI() = set_wROI;
+		hROI() = set_hROI;
+		ph->rad[id] = set_wROI/2;	// radius of the drawn head or fist
+	}
+
+	// Customise ROI boundaries
+	void setLim (int set_topLim, int set_leftLim, int set_botLim, int set_rLim) {
+		topLim = set_topLim;
+		leftLim = set_leftLim;
+		botLim =  set_botLim;
+		rLim = set_rLim;
+		limSet = true;
+	}
+	
+	// Work out where the player's figure goes on a game window of cols x rows
+	void layoutPlayer (int cols, int rows, const moTracker &leftFist, const moTracker &rFist) {
+		headRad = (int)(wROI()/2);
+		handRad = (int)(rFist.wROI()/2);
+
+		// Player 2 is drawn upside down
+		if (player2) {
+			xHead = cols - xCOM();
+			yHead = rows - yCOM();
+			xlHand = cols - leftFist.xCOM();
+			ylHand = rows - leftFist.yCOM();
+			xrHand = cols - rFist.xCOM();
+			yrHand = rows - rFist.yCOM();
+			xlEye = cols - (xCOM() - headRad/3);
+			xrEye = cols - (xCOM() + headRad/3);
+			yEye = rows - (yCOM() - headRad/3);
+		} else {
+			xHead = xCOM();
+			yHead = yCOM();
+			xlHand = leftFist.xCOM();
+			ylHand = leftFist.yCOM();
+			xrHand = rFist.xCOM();
+			yrHand = rFist.yCOM();
+			xlEye = xCOM() - headRad/3;
+			xrEye = xCOM() + headRad/3;
+			yEye = yCOM() - headRad/3;
+		}
+	}
+
+	// Everything drawPlayer paints lies inside this rectangle (after layoutPlayer)
+	Rect figureBounds () {
+		int armHalf = 6; // half the arm thickness, rounded up
+		int r = max(headRad + armHalf, 20 + 40) + 1; // head and shoulders, or the hit mouth below its centre
+		Rect bounds = Rect(xHead - r, yHead - r, 2*r + 1, 2*r + 1);
+		bounds |= Rect(xlHand - handRad - armHalf, ylHand - handRad - armHalf,
+				2*(handRad + armHalf) + 1, 2*(handRad + armHalf) + 1);
+		bounds |= Rect(xrHand - handRad - armHalf, yrHand - handRad - armHalf,
+				2*(handRad + armHalf) + 1, 2*(handRad + armHalf) + 1);
+		return bounds;
+	}
+
+	// Behaviours of a player
+	// Draw the figure laid out by layoutPlayer into one game window
+	void drawPlayer (Mat frame, const ViewTransform &view) {
+		int eyeRad = (int) headRad/10;
+
+				// Head
+		circle (frame, view(Point(xHead, yHead)), headRad, obColour, -1);
+				// Arms
+		line (frame, view(Point (xHead, yHead + p2Factor*headRad)), view(Point (xlHand, ylHand)),
+				obColour, 10);
+		line (frame, view(Point (xHead, yHead + p2Factor*headRad)), view(Point (xrHand, yrHand)),
+				obColour, 10);
+				// Fists
+		circle (frame, view(Point(xlHand, ylHand)), handRad, obColour, -1);
+		circle (frame, view(Point(xrHand, yrHand)), handRad, obColour, -1);
+				// Eyes
+		// If being hit, eyes change in to X shape
+		if (hit == true) {
+			line(frame, view(Point(xlEye - 10, yEye - 10)), view(Point(xlEye + 10, yEye + 10)), Scalar(0,0,0), 4);
+			line(frame, view(Point(xlEye + 10, yEye - 10)), view(Point(xlEye - 10, yEye + 10)), Scalar(0,0,0), 4);
+
+			line(frame, view(Point(xrEye - 10, yEye - 10)), view(Point(xrEye + 10, yEye + 10)), Scalar(0,0,0), 4);
+			line(frame, view(Point(xrEye + 10, yEye - 10)), view(Point(xrEye - 10, yEye + 10)), Scalar(0,0,0), 4);
+		}
+		
+		// If not hit, eyes are black circles
+		else {
+			circle(frame, view(Point(xlEye, yEye)), eyeRad, Scalar(0,0,0), -1);
+			circle(frame, view(Point(xrEye, yEye)), eyeRad, Scalar(0,0,0), -1);
+		}
+		
+				// Smile
+		Point smile = view(Point(xHead, yHead));
+
+		// If being hit, mouth changes into a black circle
+		if (hit == true) {
+			if (player2) {
+				circle(frame, view(Point(xHead, yHead - 20)), 20, Scalar(0,0,0), -1);
+			} else {
+				circle(frame, view(Point(xHead, yHead + 40)), 20, Scalar(0,0,0), -1);
+			}
+		}
+		
+		// If not hit, smile !!
+		// (the arc ellipse() would draw, built in a vector kept from frame to frame instead of a new one)
+		else {
+			int smileRad = headRad/2;
+			int step = smileRad < 3 ? 90 : smileRad < 10 ? 30 : smileRad < 15 ? 18 : 5;
+			ellipse2Poly(smile, Size(smileRad, smileRad), 180 + (int) view.angle(), 0, player2 ? 180 : -180,
+					step, smileArc);
+			const Point *arc = &smileArc[0];
+			int nArc = (int) smileArc.size();
+			polylines(frame, &arc, &nArc, 1, false, Scalar(0,0,0), 4, 8);
+		}
+
+	}
+	
+	// Set factors for player 2
+	void p2 () {
+		p2Factor = -1;
+		player2 = true;
+	}
+	
+	// Count hits and recovery, and size the stamina bar for a game window "cols" wide
+	void updateStamina (int cols, const moTracker &LFist, const moTracker &rFist) {
+		// This function is only used by head motion tracker of each player
+
+		// If fist and head are touching, it counts as a hit
+		if (LFist.isTouching() || rFist.isTouching()) {
+			if (!hit && hitNo < 5) {
+				hitNo ++;
+				hitsTaken++;
+				hit = true;
+			}
+		} else if (!LFist.isTouching() && !rFist.isTouching()) { hit = false; }
+		
+		// If not being hit for a period of time, the player recovers health
+		if (!hit) {
+			countFrame++;
+			if (countFrame % recoveryFrames == 0 && hitNo > 0) {
+				hitNo--;
+			}
+		} else countFrame = 0;
+		
+		// Visualise stamina bar
+		wBar = (5 - hitNo)*maxStat/5;
+
+		if (!player2) {
+			xBar = (int)(cols*11/16) + hitNo/5*maxStat;
+		}
+	}
+
+	void drawStaminaBar (Mat frame, const ViewTransform &view) {
+		// Representation of stamina
+		rectangle (frame, view(Rect(xBar, yBar, wBar, hBar)),
+									Scalar (0,0,255), -1);
+	}
+
+	void drawStaminaBox (Mat frame, const ViewTransform &view, Scalar colour) {
+		// Representation of stamina's border case
+		rectangle (frame, view(Rect(xBox, yBox, wBox, hBox)),
+									colour, 2);
+	}
+
+	// The stamina bar and its border lie inside this rectangle
+	Rect staminaBounds () {
+		return Rect(xBox - 2, yBox - 2, wBox + 4, hBox + 4);
+	}
+};
+// Finish motion tracker & player setup
+
+	// How the trackers look for their colour, as chosen on the command line
+struct TrackerOptions {
+	bool fused;		// fused threshold + COM kernel instead of inRange masks
+	bool roiOnly;		// masks only cover the ROIs instead of the whole frame
+	bool predictive;	// search around the predicted position instead of the ROI
+	int headLevel;		// pyramid level of the heads' coarse-to-fine search, 0 for none
+	int fistLevel;		// same for the fists
+	bool blobs;		// label each colour band once per frame and hand out its components
+	bool labels;		// read one colour-class label image instead of testing each band on its own
+
+	TrackerOptions () {
+		blobs = false;
+		labels = false;
+		fused = true;
+		roiOnly = true;
+		predictive = false;
+		headLevel = 0;
+		fistLevel = 0;
+	}
+
+	// Set up one player's trackers
+	void apply (moTracker &head, moTracker &lHand, moTracker &rHand) const {
+		moTracker *trackers[] = { &head, &lHand, &rHand };
+		for (int i = 0; i < 3; i++) {
+			trackers[i]->fused = fused;
+			trackers[i]->roiOnly = roiOnly;
+			trackers[i]->predictive = predictive;
+			trackers[i]->pyramidLevel = i == 0 ? headLevel : fistLevel;
+			trackers[i]->blobs = blobs;
+			trackers[i]->labelled = labels;
+		}
+	}
+};
+
+	// Everything about the game and its trackers that is tuned per venue, read from a settings file
+	// ("key = value" lines, # starts a comment; see boxing.cfg). Anything the file leaves out keeps
+	// the value below. The colour bands can be reloaded while the game runs.
+struct GameSettings {
+	Scalar headDarker, headBrighter;	// colour band of the heads (B, G, R)
+	Scalar fistDarker, fistBrighter;	// colour band of the fists
+	int headSize, fistSize;			// side of the ROIs, pixels
+	int headY, fistY;			// top of the ROIs at the start
+	double limitTop, limitLeft, limitRight;	// where heads may go, as fractions of the frame
+	int maxStat;				// length of a full stamina bar
+	int recoveryFrames;			// frames without a hit that take one hit off
+	TrackerOptions tracking;		// command line flags override these
+
+	GameSettings () {
+		headDarker = Scalar(10,10,194);
+		headBrighter = Scalar(125,125,249);
+		fistDarker = Scalar(0,164,164);
+		fistBrighter = Scalar(125,255,255);
+		headSize = 150;
+		fistSize = 100;
+		headY = 200;
+		fistY = 300;
+		limitTop = 1.0/2;
+		limitLeft = 1.0/7;
+		limitRight = 6.0/7;
+		maxStat = 160;
+		recoveryFrames = 100;
+	}
+
+	// Read "path" over the current values. On an error "error" says what and where, and some
+	// values may already have changed: load into a copy to keep the old ones.
+	bool load (string path, string &error) {
+		FILE *file = fopen(path.c_str(), "r");
+		if (file == NULL) {
+			error = "cannot open " + path;
+			return false;
+		}
+		char text[256];
+		int lineNo = 0;
+		bool ok = true;
+		while (ok && fgets(text, sizeof(text), file) != NULL) {
+			lineNo++;
+			string line = text;
+			line = line.substr(0, line.find('#'));
+			size_t eq = line.find('=');
+			string key = trim(line.substr(0, eq));
+			if (key.empty()) {
+				continue;
+			}
+			if (eq == string::npos) {
+				ok = false;
+			} else {
+				ok = set(key, trim(line.substr(eq + 1)));
+			}
+			if (!ok) {
+				char where[32];
+				snprintf(where, sizeof(where), " line %d", lineNo);
+				error = path + where + ": cannot use \"" + trim(line) + "\"";
+			}
+		}
+		fclose(file);
+		return ok && validate(error);
+	}
+
+	// Take the colour bands from "path" if all of it is valid, keeping everything else
+	bool reloadBands (string path, string &error) {
+		GameSettings fresh = *this;
+		if (!fresh.load(path, error)) {
+			return false;
+		}
+		headDarker = fresh.headDarker;
+		headBrighter = fresh.headBrighter;
+		fistDarker = fresh.fistDarker;
+		fistBrighter = fresh.fistBrighter;
+		return true;
+	}
+
+	bool validate (string &error) const {
+		Scalar bands[][2] = { { headDarker, headBrighter }, { fistDarker, fistBrighter } };
+		for (int b = 0; b < 2; b++) {
+			for (int c = 0; c < 3; c++) {
+				if (bands[b][0][c] < 0 || bands[b][1][c] > 255 || bands[b][0][c] > bands[b][1][c]) {
+					error = "colour bands need 0 <= darker <= brighter <= 255 on each channel";
+					return false;
+				}
+			}
+		}
+		if (headSize <= 0 || fistSize <= 0 || headY < 0 || fistY < 0) {
+			error = "ROI sizes must be positive and their positions not negative";
+			return false;
+		}
+		if (limitTop < 0.0 || limitTop >= 1.0 || limitLeft < 0.0 || limitLeft >= limitRight || limitRight > 1.0) {
+			error = "head limits need 0 <= top < 1 and 0 <= left < right <= 1";
+			return false;
+		}
+		if (maxStat <= 0 || recoveryFrames <= 0) {
+			error = "max_stamina and recovery_frames must be positive";
+			return false;
+		}
+		if (tracking.headLevel < 0 || tracking.headLevel > FramePyramid::maxLevel
+				|| tracking.fistLevel < 0 || tracking.fistLevel > FramePyramid::maxLevel) {
+			char text[64];
+			snprintf(text, sizeof(text), "pyramid levels must be between 0 and %d", FramePyramid::maxLevel);
+			error = text;
+			return false;
+		}
+		return true;
+	}
+
+	// The colour classes of the label path: one per band
+	ColourClassifier classifier () const {
+		ColourClassifier classes;
+		classes.add(headDarker, headBrighter);
+		classes.add(fistDarker, fistBrighter);
+		return classes;
+	}
+
+	// Set one value as a line of the settings file would ("head_size", "150"); false if it cannot be used
+	bool assign (string key, string value) {
+		return set(trim(key), trim(value));
+	}
+
+	// Set up one player's trackers
+	void apply (moTracker &head, moTracker &lHand, moTracker &rHand) const {
+		tracking.apply(head, lHand, rHand);
+		head.maxStat = maxStat;
+		head.recoveryFrames = recoveryFrames;
+	}
+
+private:
+	static string trim (string text) {
+		size_t first = text.find_first_not_of(" \t\r\n");
+		if (first == string::npos) {
+			return "";
+		}
+		return text.substr(first, text.find_last_not_of(" \t\r\n") - first + 1);
+	}
+
+	// Parse one value; false if the key is unknown or the value is not what it should be
+	bool set (string key, string value) {
+		int b, g, r, n;
+		char extra;
+		bool isBand = sscanf(value.c_str(), "%d %d %d %c", &b, &g, &r, &extra) == 3;
+		bool isInt = sscanf(value.c_str(), "%d %c", &n, &extra) == 1;
+		double x;
+		bool isReal = sscanf(value.c_str(), "%lf %c", &x, &extra) == 1;
+		bool isFlag = isInt && (n == 0 || n == 1);
+
+		Scalar *bands[] = { &headDarker, &headBrighter, &fistDarker, &fistBrighter };
+		const char *bandKeys[] = { "head_darker", "head_brighter", "fist_darker", "fist_brighter" };
+		for (int k = 0; k < 4; k++) {
+			if (key == bandKeys[k]) {
+				if (!isBand) {
+					return false;
+				}
+				*bands[k] = Scalar(b, g, r);
+				return true;
+			}
+		}
+		int *ints[] = { &headSize, &fistSize, &headY, &fistY, &maxStat, &recoveryFrames,
+				&tracking.headLevel, &tracking.fistLevel };
+		const char *intKeys[] = { "head_size", "fist_size", "head_y", "fist_y", "max_stamina", "recovery_frames",
+				"head_pyramid", "fist_pyramid" };
+		for (int k = 0; k < 8; k++) {
+			if (key == intKeys[k]) {
+				if (!isInt) {
+					return false;
+				}
+				*ints[k] = n;
+				return true;
+			}
+		}
+		double *reals[] = { &limitTop, &limitLeft, &limitRight };
+		const char *realKeys[] = { "head_limit_top", "head_limit_left", "head_limit_right" };
+		for (int k = 0; k < 3; k++) {
+			if (key == realKeys[k]) {
+				if (!isReal) {
+					return false;
+				}
+				*reals[k] = x;
+				return true;
+			}
+		}
+		bool *flags[] = { &tracking.fused, &tracking.roiOnly, &tracking.predictive, &tracking.blobs, &tracking.labels };
+		const char *flagKeys[] = { "fused", "roi_only", "predictive", "blobs", "labels" };
+		for (int k = 0; k < 5; k++) {
+			if (key == flagKeys[k]) {
+				if (!isFlag) {
+					return false;
+				}
+				*flags[k] = n == 1;
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+// When "path" was last written, 0 if it does not exist
+time_t modifiedTime (string path) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		return 0;
+	}
+	return st.st_mtime;
+}
+
+// Starting ROIs, colours and limits of both players for the given camera frames
+void setupPlayers (Mat frame, Mat frame2, const GameSettings &settings, moTracker &p1, moTracker &p1LHand,
+		moTracker &p1RHand, moTracker &p2, moTracker &p2LHand, moTracker &p2RHand) {
+	int head = settings.headSize, fist = settings.fistSize;
+	p2.p2(); p2LHand.p2(); p2RHand.p2();
+
+	p1.setROI (frame.cols/2 - 100, settings.headY, head, head);
+	p1.setColour(Scalar(255,0,0));
+	p1.setLim ((int)(frame.rows*settings.limitTop), (int)(frame.cols*settings.limitLeft), frame.rows,
+			(int)(frame.cols*settings.limitRight));
+	p1LHand.setROI (10, settings.fistY, fist, fist);
+	p1RHand.setROI (frame.cols-10, settings.fistY, fist, fist);
+
+	p2.setROI (frame2.cols/2 - 100, settings.headY, head, head);
+	p2.setLim ((int)(frame2.rows*settings.limitTop), (int)(frame2.cols*settings.limitLeft), frame2.rows,
+			(int)(frame2.cols*settings.limitRight));
+	p2LHand.setROI (10, settings.fistY, fist, fist);
+	p2.setColour (Scalar (0,255,0));
+	p2RHand.setROI (frame2.cols-10, settings.fistY, fist, fist);
+
+	settings.apply(p1, p1LHand, p1RHand);
+	settings.apply(p2, p2LHand, p2RHand);
+}
+
+// Give each tracker the component nearest to where it should be, among those within its reach;
+// no component goes to two trackers
+void assignBlobs (const vector<Blob> &blobs, moTracker *trackers[], Rect reach[], int n) {
+	const Blob *taken[3] = { NULL, NULL, NULL };
+	bool done[3] = { false, false, false };
+
+	// Closest pair first, until no tracker has a free component in reach
+	for (int pass = 0; pass < n; pass++) {
+		int bestT = -1;
+		size_t bestB = 0;
+		double bestD2 = 0.0;
+		for (int t = 0; t < n; t++) {
+			if (done[t]) {
+				continue;
+			}
+			Point2d pred = trackers[t]->predicted();
+			for (size_t b = 0; b < blobs.size(); b++) {
+				bool available = true;
+				for (int u = 0; u < n; u++) {
+					available = available && taken[u] != &blobs[b];
+				}
+				if (!available || !reach[t].contains(Point((int) blobs[b].x, (int) blobs[b].y))) {
+					continue;
+				}
+				double d2 = (blobs[b].x - pred.x)*(blobs[b].x - pred.x) + (blobs[b].y - pred.y)*(blobs[b].y - pred.y);
+				if (bestT < 0 || d2 < bestD2) {
+					bestT = t;
+					bestB = b;
+					bestD2 = d2;
+				}
+			}
+		}
+		if (bestT < 0) {
+			break;
+		}
+		taken[bestT] = &blobs[bestB];
+		done[bestT] = true;
+	}
+
+	for (int t = 0; t < n; t++) {
+		trackers[t]->takeBlob(taken[t]);
+	}
+}
+
+// Blob tracking of one player: the head band and the fist band are each labelled once,
+// over the region the trackers of that band can reach, and the components handed out
+void trackBlobs (Mat frame, int frameNo, CameraCache &camera, const GameSettings &settings,
+		moTracker &head, moTracker &lHand, moTracker &rHand) {
+	BlobFinder &finder = camera.blobs;
+	int64 start = getTickCount();
+	int64 labelled = finder.pixelsLabelled;
+	head.prepare(frame);
+	lHand.prepare(frame);
+	rHand.prepare(frame);
+
+	moTracker *heads[] = { &head };
+	Rect headReach[] = { head.reach(frame) };
+	head.searchWindow = headReach[0];
+	assignBlobs(finder.find(frame, frameNo, settings.headDarker, settings.headBrighter, headReach[0], camera.masks,
+			settings.tracking.labels),
+			heads, headReach, 1);
+	int64 now = getTickCount();
+	head.chargeFeed(now - start, finder.pixelsLabelled - labelled);
+
+	// Both fists share the yellow band: one labelling serves both, and each is charged half of it
+	start = now;
+	labelled = finder.pixelsLabelled;
+	moTracker *fists[] = { &lHand, &rHand };
+	Rect fistReach[] = { lHand.reach(frame), rHand.reach(frame) };
+	lHand.searchWindow = fistReach[0];
+	rHand.searchWindow = fistReach[1];
+	assignBlobs(finder.findEither(frame, frameNo, settings.fistDarker, settings.fistBrighter, fistReach[0], fistReach[1],
+			camera.masks, settings.tracking.labels),
+			fists, fistReach, 2);
+	int64 ticks = getTickCount() - start, pixels = finder.pixelsLabelled - labelled;
+	lHand.chargeFeed(ticks/2, pixels/2);
+	rHand.chargeFeed(ticks - ticks/2, pixels - pixels/2);
+}
+
+// Calculate COM of one player's head and fists on the player's own camera frame
+void feedPlayer (Mat frame, int frameNo, CameraCache &camera, const GameSettings &settings,
+		moTracker &head, moTracker &lHand, moTracker &rHand) {
+	if (settings.tracking.blobs) {
+		trackBlobs(frame, frameNo, camera, settings, head, lHand, rHand);
+		return;
+	}
+
+	//Calculate COM and feed each frame captured
+	head.feedNewframe(frame, settings.headDarker, settings.headBrighter, camera, frameNo);
+	lHand.feedNewframe(frame, settings.fistDarker, settings.fistBrighter, camera, frameNo);
+	rHand.feedNewframe(frame, settings.fistDarker, settings.fistBrighter, camera, frameNo);
+}
+
+// Update final position of one player's ROIs
+void updatePlayerROI (Mat frame, moTracker &head, moTracker &lHand, moTracker &rHand) {
+	head.updateROI(frame);
+	lHand.updateROI(frame);
+	rHand.updateROI(frame);
+}
+
+// Visualise one player's ROIs on the player's frame
+void drawPlayerROI (Mat frame, moTracker &head, moTracker &lHand, moTracker &rHand) {
+	head.drawROI (frame);
+	lHand.drawROI (frame);
+	rHand.drawROI (frame);
+}
+
+// Move one player's ROIs to their final position and show them on the player's frame
+void placePlayer (Mat frame, moTracker &head, moTracker &lHand, moTracker &rHand) {
+	updatePlayerROI(frame, head, lHand, rHand);
+	drawPlayerROI(frame, head, lHand, rHand);
+}
+
+// Visualise both players and their stamina on both game windows; player 2 sees the scene upside down
+void drawGame (Mat game, Mat game2, moTracker &p1, moTracker &p1LHand, moTracker &p1RHand,
+		moTracker &p2, moTracker &p2LHand, moTracker &p2RHand) {
+	Mat views[2] = { game, game2 };
+	ViewTransform transforms[2] = { ViewTransform(game.cols, game.rows, false), ViewTransform(game.cols, game.rows, true) };
+	int v;
+
+	p1.layoutPlayer(game.cols, game.rows, p1LHand, p1RHand);
+	p2.layoutPlayer(game.cols, game.rows, p2LHand, p2RHand);
+
+	// A black background to erase previous image
+	for (v = 0; v < 2; v++) {
+		rectangle (views[v], Rect(0,0, game.cols, game.rows), Scalar (0,0,0), -1);
+		p1.drawPlayer (views[v], transforms[v]);
+	}
+	p1.updateStamina (game.cols, p2LHand, p2RHand);
+	for (v = 0; v < 2; v++) {
+		p1.drawStaminaBar (views[v], transforms[v]);
+		p1.drawStaminaBox (views[v], transforms[v], Scalar (255,255,255));
+		p2.drawPlayer (views[v], transforms[v]);
+	}
+	p2.updateStamina (game.cols, p1LHand, p1RHand);
+	for (v = 0; v < 2; v++) {
+		p2.drawStaminaBar (views[v], transforms[v]);
+		p2.drawStaminaBox (views[v], transforms[v], Scalar (255,255,255));
+	}
+}
+
+// Each player's name is written at the bottom of their own view
+void labelViews (Mat game, Mat game2, string player1Str, string player2Str) {
+	putText(game, player2Str, Point(400,70), FONT_HERSHEY_PLAIN, 3, Scalar(255,255,255), 2);
+	putText(game, player1Str, Point(150,450), FONT_HERSHEY_PLAIN, 3, Scalar(255,255,255), 2);
+
+	putText(game2, player1Str, Point(400,70), FONT_HERSHEY_PLAIN, 3, Scalar(255,255,255), 2);
+	putText(game2, player2Str, Point(150,450), FONT_HERSHEY_PLAIN, 3, Scalar(255,255,255), 2);
+}
+
+	// Draws the game windows incrementally: only the regions where a figure or a stamina bar
+	// was last frame or is now get cleared and redrawn, and the name labels and bar borders
+	// are stamped from layers rendered once per match
+class GameRenderer {
+public:
+	string name1, name2;	// players' names
+	Mat overlay[2];		// labels and stamina borders of each view
+	Mat overlayMask[2];	// where overlay[v] has something drawn
+	bool overlayReady;
+	vector<Rect> drawn;	// regions painted last frame, in scene (player 1's view) coordinates
+	vector<Rect> dirty;	// regions repainted this frame
+	bool ready;		// false until both views hold a complete frame
+
+	// Counters
+	int64 frames;
+	int64 pixelsWritten;	// pixels cleared or stamped
+
+	GameRenderer (string set_name1, string set_name2) {
+		name1 = set_name1;
+		name2 = set_name2;
+		overlayReady = false;
+		ready = false;
+		frames = 0;
+		pixelsWritten = 0;
+	}
+
+	// Keep the label and border layers in buffers of "pool"
+	void useBuffers (BufferPool &pool) {
+		for (int v = 0; v < 2; v++) {
+			overlay[v] = pool.take(CV_8UC3);
+			overlayMask[v] = pool.take(CV_8UC1);
+		}
+	}
+
+	// Forget what the views hold, e.g. after a "You Win" screen was drawn over them
+	void invalidate () {
+		ready = false;
+	}
+
+	// Draw both players and their stamina bars straight into both views, clearing only what changed
+	void drawScene (Mat game, Mat game2, moTracker &p1, moTracker &p1LHand, moTracker &p1RHand,
+			moTracker &p2, moTracker &p2LHand, moTracker &p2RHand) {
+		Mat views[2] = { game, game2 };
+		ViewTransform transforms[2] = { ViewTransform(game.cols, game.rows, false), ViewTransform(game.cols, game.rows, true) };
+		Rect whole = Rect(0, 0, game.cols, game.rows);
+		int v;
+
+		if (!overlayReady) {
+			prepareOverlays(transforms, p1, p2);
+		}
+
+		// Repaint where things were and where they are now
+		p1.layoutPlayer(game.cols, game.rows, p1LHand, p1RHand);
+		p2.layoutPlayer(game.cols, game.rows, p2LHand, p2RHand);
+		dirty = drawn;
+		drawn.clear();
+		drawn.push_back(p1.figureBounds() & whole);
+		drawn.push_back(p2.figureBounds() & whole);
+		drawn.push_back(p1.staminaBounds() & whole);
+		drawn.push_back(p2.staminaBounds() & whole);
+		dirty.insert(dirty.end(), drawn.begin(), drawn.end());
+		if (!ready) {
+			dirty.clear();
+			dirty.push_back(whole);
+		}
+
+		// A black background to erase previous image
+		for (v = 0; v < 2; v++) {
+			for (size_t i = 0; i < dirty.size(); i++) {
+				views[v](transforms[v](dirty[i])).setTo(Scalar(0,0,0));
+				pixelsWritten += dirty[i].area();
+			}
+			p1.drawPlayer (views[v], transforms[v]);
+		}
+		p1.updateStamina (game.cols, p2LHand, p2RHand);
+		for (v = 0; v < 2; v++) {
+			p1.drawStaminaBar (views[v], transforms[v]);
+			p2.drawPlayer (views[v], transforms[v]);
+		}
+		p2.updateStamina (game.cols, p1LHand, p1RHand);
+		for (v = 0; v < 2; v++) {
+			p2.drawStaminaBar (views[v], transforms[v]);
+		}
+	}
+
+	// Stamp the labels and borders on both views
+	void finishViews (Mat game, Mat game2) {
+		Mat views[2] = { game, game2 };
+		ViewTransform view2(game.cols, game.rows, true);
+
+		for (size_t i = 0; i < dirty.size(); i++) {
+			Rect r[2] = { dirty[i], view2(dirty[i]) };
+			for (int v = 0; v < 2; v++) {
+				Mat region = views[v](r[v]);
+				overlay[v](r[v]).copyTo(region, overlayMask[v](r[v]));
+				pixelsWritten += r[v].area();
+			}
+		}
+		ready = true;
+		frames++;
+	}
+
+	void printStats (int cols, int rows) {
+		printf("Renderer: %.0f pixels written/frame (a full redraw clears %d)\n",
+				frames ? (double) pixelsWritten/frames : 0.0, 2*cols*rows);
+	}
+
+private:
+	// Render the static layers once: stamina borders (part of the scene, so upside down in view 2)
+	// and the names, each player's own name at the bottom of their view
+	void prepareOverlays (const ViewTransform transforms[2], moTracker &p1, moTracker &p2) {
+		for (int v = 0; v < 2; v++) {
+			overlay[v].create(transforms[v].rows, transforms[v].cols, CV_8UC3);
+			overlay[v].setTo(Scalar(0,0,0));
+			p1.drawStaminaBox(overlay[v], transforms[v], Scalar (255,255,255));
+			p2.drawStaminaBox(overlay[v], transforms[v], Scalar (255,255,255));
+		}
+		labelViews(overlay[0], overlay[1], name1, name2);
+		for (int v = 0; v < 2; v++) {
+			Mat gray;
+			cvtColor(overlay[v], gray, CV_BGR2GRAY);
+			threshold(gray, overlayMask[v], 0, 255, THRESH_BINARY);
+		}
+		overlayReady = true;
+	}
+};
+
+	// Match event stream: a header, then per frame one frame record (time and the six COMs) followed by
+	// a record for every touch flag, hit flag, hit count and stamina bar that changed on that frame.
+	// All numbers are little-endian.
+	//   header: "BXLG", u16 version, u16 cols, u16 rows, two names as u8 length + bytes
+	//   'F' u32 frameNo, i64 microseconds since the match started, 6 x (i16 xCOM, i16 yCOM)
+	//   'T' u8 tracker, u8 isTouching      'H' u8 player, u8 hit
+	//   'N' u8 player, u8 hitNo            'B' u8 player, i16 wBar
+	//   'E' u8 length + winner's name, at the end of the match
+enum { EVENT_FRAME = 'F', EVENT_TOUCH = 'T', EVENT_HIT = 'H', EVENT_HITNO = 'N', EVENT_BAR = 'B', EVENT_END = 'E' };
+
+	// Writes the event stream on its own thread: the game loop only appends a few bytes per frame
+	// to a buffer and never waits for the disk
+class EventLog {
+public:
+	FILE *file;
+	vector<unsigned char> filling;	// appended to by the game loop
+	vector<unsigned char> writing;	// being written by the writer thread
+	bool stopping;
+	mutex lock;
+	condition_variable ready;
+	thread writer;
+
+	// Last values recorded, so that only changes are
+	bool touching[Physics::N];
+	int hit[2], hitNo[2], wBar[2];
+	int64 startTicks;
+
+	// Counters
+	int64 frames;
+	int64 bytes;
+
+	EventLog () {
+		file = NULL;
+		stopping = false;
+		frames = 0;
+		bytes = 0;
+	}
+	~EventLog () {
+		close();
+	}
+
+	bool open (string path, int cols, int rows, string name1, string name2) {
+		file = fopen(path.c_str(), "wb");
+		if (file == NULL) {
+			return false;
+		}
+		filling.reserve(1 << 16);
+		writing.reserve(1 << 16);
+		for (int i = 0; i < Physics::N; i++) {
+			touching[i] = false;
+		}
+		for (int p = 0; p < 2; p++) {
+			hit[p] = hitNo[p] = wBar[p] = -1; // the first frame records everything
+		}
+		startTicks = getTickCount();
+
+		const char magic[] = "BXLG";
+		filling.insert(filling.end(), magic, magic + 4);
+		put16(1);
+		put16(cols);
+		put16(rows);
+		putName(name1);
+		putName(name2);
+		writer = thread(&EventLog::run, this);
+		return true;
+	}
+
+	// Record the state of the match after frame "frameNo" was resolved and drawn
+	void recordFrame (int frameNo, const Physics &ph, const moTracker &p1, const moTracker &p2) {
+		if (file == NULL) {
+			return;
+		}
+		const moTracker *players[] = { &p1, &p2 };
+		size_t before;
+		bool full;
+		{
+			lock_guard<mutex> guard(lock);
+			before = filling.size();
+			filling.push_back(EVENT_FRAME);
+			put32(frameNo);
+			put64((getTickCount() - startTicks)*1000000/(int64) getTickFrequency());
+			for (int i = 0; i < Physics::N; i++) {
+				put16(ph.xCOM[i]);
+				put16(ph.yCOM[i]);
+			}
+			for (int i = 0; i < Physics::N; i++) {
+				if (ph.isTouching[i] != touching[i] || frames == 0) {
+					touching[i] = ph.isTouching[i];
+					filling.push_back(EVENT_TOUCH);
+					filling.push_back((unsigned char) i);
+					filling.push_back(touching[i] ? 1 : 0);
+				}
+			}
+			for (int p = 0; p < 2; p++) {
+				if (players[p]->hit != (hit[p] == 1) || frames == 0) {
+					hit[p] = players[p]->hit ? 1 : 0;
+					filling.push_back(EVENT_HIT);
+					filling.push_back((unsigned char) p);
+					filling.push_back((unsigned char) hit[p]);
+				}
+				if (players[p]->hitNo != hitNo[p]) {
+					hitNo[p] = players[p]->hitNo;
+					filling.push_back(EVENT_HITNO);
+					filling.push_back((unsigned char) p);
+					filling.push_back((unsigned char) hitNo[p]);
+				}
+				if (players[p]->wBar != wBar[p]) {
+					wBar[p] = players[p]->wBar;
+					filling.push_back(EVENT_BAR);
+					filling.push_back((unsigned char) p);
+					put16(wBar[p]);
+				}
+			}
+			bytes += filling.size() - before;
+			frames++;
+			full = filling.size() >= 4096;
+		}
+		if (full) {
+			ready.notify_one();
+		}
+	}
+
+	void recordEnd (string winner) {
+		if (file == NULL) {
+			return;
+		}
+		lock_guard<mutex> guard(lock);
+		filling.push_back(EVENT_END);
+		putName(winner);
+	}
+
+	// Write what is left and close the file
+	void close () {
+		if (file == NULL) {
+			return;
+		}
+		{
+			lock_guard<mutex> guard(lock);
+			stopping = true;
+		}
+		ready.notify_one();
+		writer.join();
+		fclose(file);
+		file = NULL;
+	}
+
+	void printStats (string path) {
+		printf("Event log %s: %lld frames, %lld bytes (%.1f bytes/frame)\n", path.c_str(),
+				(long long) frames, (long long) bytes, frames ? (double) bytes/frames : 0.0);
+	}
+
+private:
+	// Callers hold "lock" (or are the only thread, before the writer starts)
+	void put16 (int v) {
+		filling.push_back((unsigned char) (v & 0xff));
+		filling.push_back((unsigned char) ((v >> 8) & 0xff));
+	}
+	void put32 (int64 v) {
+		put16((int) (v & 0xffff));
+		put16((int) ((v >> 16) & 0xffff));
+	}
+	void put64 (int64 v) {
+		put32(v & 0xffffffff);
+		put32((v >> 32) & 0xffffffff);
+	}
+	void putName (string name) {
+		int n = min((int) name.size(), 255);
+		filling.push_back((unsigned char) n);
+		filling.insert(filling.end(), name.begin(), name.begin() + n);
+	}
+
+	void run () {
+		while (true) {
+			{
+				unique_lock<mutex> guard(lock);
+				// Wake for a full buffer, at the end, or every 100 ms so a crash loses little
+				ready.wait_for(guard, chrono::milliseconds(100), [this] { return stopping || filling.size() >= 4096; });
+				swap(filling, writing); // both keep their capacity
+			}
+			if (!writing.empty()) {
+				fwrite(&writing[0], 1, writing.size(), file);
+				writing.clear();
+			}
+			lock_guard<mutex> guard(lock);
+			if (stopping && filling.empty()) {
+				break;
+			}
+		}
+		fflush(file);
+	}
+};
+
+	// Reads an event stream written by EventLog, one record at a time
+class EventReader {
+public:
+	vector<unsigned char> data;	// the whole file: logs are small and this reads fastest
+	size_t pos;
+	int cols, rows;
+	string name1, name2;
+
+	// One record; only the fields of its type are set
+	struct Record {
+		int type;
+		int frameNo;
+		int64 micros;
+		int xCOM[Physics::N], yCOM[Physics::N];
+		int who;		// tracker for 'T', player (0 or 1) for 'H', 'N' and 'B'
+		int value;
+		string winner;
+	};
+
+	bool open (string path) {
+		FILE *file = fopen(path.c_str(), "rb");
+		if (file == NULL) {
+			return false;
+		}
+		unsigned char chunk[1 << 16];
+		size_t n;
+		while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+			data.insert(data.end(), chunk, chunk + n);
+		}
+		fclose(file);
+
+		pos = 0;
+		if (data.size() < 10 || memcmp(&data[0], "BXLG", 4) != 0) {
+			return false;
+		}
+		pos = 4;
+		if (get16() != 1) {
+			return false;
+		}
+		cols = get16();
+		rows = get16();
+		name1 = getName();
+		name2 = getName();
+		return pos <= data.size();
+	}
+
+	// Next record; false at the end of the stream or on a truncated record
+	bool next (Record &r) {
+		if (pos >= data.size()) {
+			return false;
+		}
+		r.type = data[pos++];
+		switch (r.type) {
+		case EVENT_FRAME:
+			if (!have(4 + 8 + 4*Physics::N)) {
+				return false;
+			}
+			r.frameNo = (int) get32();
+			r.micros = get32();
+			r.micros |= get32() << 32;
+			for (int i = 0; i < Physics::N; i++) {
+				r.xCOM[i] = (short) get16();
+				r.yCOM[i] = (short) get16();
+			}
+			return true;
+		case EVENT_TOUCH:
+		case EVENT_HIT:
+		case EVENT_HITNO:
+			if (!have(2)) {
+				return false;
+			}
+			r.who = data[pos++];
+			r.value = data[pos++];
+			return true;
+		case EVENT_BAR:
+			if (!have(3)) {
+				return false;
+			}
+			r.who = data[pos++];
+			r.value = (short) get16();
+			return true;
+		case EVENT_END:
+			r.winner = getName();
+			return pos <= data.size();
+		}
+		return false; // unknown record type
+	}
+
+private:
+	bool have (size_t n) {
+		return pos + n <= data.size();
+	}
+	int get16 () {
+		if (!have(2)) {
+			pos = data.size() + 1;
+			return 0;
+		}
+		int v = data[pos] | (data[pos + 1] << 8);
+		pos += 2;
+		return v;
+	}
+	int64 get32 () {
+		int64 lo = get16();
+		return lo | ((int64) get16() << 16);
+	}
+	string getName () {
+		if (!have(1)) {
+			pos = data.size() + 1;
+			return "";
+		}
+		size_t n = data[pos++];
+		if (!have(n)) {
+			pos = data.size() + 1;
+			return "";
+		}
+		string name(data.begin() + pos, data.begin() + pos + n);
+		pos += n;
+		return name;
+	}
+};
+
+	// A file mapped into memory read-write, grown by mapping it again with a larger size
+class MappedFile {
+public:
+	unsigned char *data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file, mapping;
+#else
+	int fd;
+#endif
+
+	MappedFile () {
+		data = NULL;
+		size = 0;
+#ifdef _WIN32
+		file = mapping = NULL;
+#else
+		fd = -1;
+#endif
+	}
+	~MappedFile () {
+		unmap();
+	}
+
+	// Map the whole file, first extending it to at least minSize bytes (new bytes read as zeros)
+	bool map (string path, size_t minSize) {
+		unmap();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+				OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			file = NULL;
+			return false;
+		}
+		LARGE_INTEGER existing;
+		GetFileSizeEx(file, &existing);
+		size = max((size_t) existing.QuadPart, minSize);
+		// the mapping extends the file to its size
+		mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD) ((uint64_t) size >> 32),
+				(DWORD) (size & 0xffffffff), NULL);
+		if (mapping != NULL) {
+			data = (unsigned char *) MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+		}
+#else
+		fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat st;
+		fstat(fd, &st);
+		size = max((size_t) st.st_size, minSize);
+		if ((size_t) st.st_size < size && ftruncate(fd, size) != 0) {
+			unmap();
+			return false;
+		}
+		void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		data = p == MAP_FAILED ? NULL : (unsigned char *) p;
+#endif
+		if (data == NULL) {
+			unmap();
+			return false;
+		}
+		return true;
+	}
+
+	// Ask the OS to write the pages back now rather than when it likes
+	void flush () {
+		if (data != NULL) {
+#ifdef _WIN32
+			FlushViewOfFile(data, size);
+#else
+			msync(data, size, MS_ASYNC);
+#endif
+		}
+	}
+
+	void unmap () {
+#ifdef _WIN32
+		if (data != NULL) UnmapViewOfFile(data);
+		if (mapping != NULL) CloseHandle(mapping);
+		if (file != NULL) CloseHandle(file);
+		file = mapping = NULL;
+#else
+		if (data != NULL) munmap(data, size);
+		if (fd >= 0) ::close(fd);
+		fd = -1;
+#endif
+		data = NULL;
+		size = 0;
+	}
+};
+
+	// One finished match, as stored in the history file. The layout is the file format: only add
+	// fields by using up "reserved" and keep the size
+struct MatchRecord {
+	enum { NAME_LEN = 32 };	// names are cut to NAME_LEN - 1 characters
+	char player1[NAME_LEN];
+	char player2[NAME_LEN];
+	char winner[NAME_LEN];	// empty when the match was abandoned
+	int64 started;		// seconds since 1970 when the match started
+	int durationMs;
+	int frames;
+	short hits1, hits2;	// hits landed by player 1 and by player 2
+	int reserved[3];
+};
+static_assert(sizeof(MatchRecord) == 128, "MatchRecord is the history file format");
+
+	// History of every match: a memory-mapped array of MatchRecords behind a small header, and an
+	// index by player name that is built when the file is opened and kept up to date by add().
+	// A player's totals are a hash lookup and the top N by wins is a walk from the start of a set.
+class MatchHistory {
+public:
+	struct Header {
+		char magic[8];		// "BXHIST\0\0"
+		int version;
+		int recordSize;
+		int64 count;		// records in use
+	};
+	struct PlayerStats {
+		int wins, losses, played;
+	};
+
+	MappedFile file;
+	string path;
+	Header *header;
+	MatchRecord *records;
+	int64 capacity;		// records that fit in the mapping
+	unordered_map<string, PlayerStats> players;
+	set<pair<int, string> > ranking;	// (-wins, name) for every player, leader first
+
+	MatchHistory () {
+		header = NULL;
+		records = NULL;
+		capacity = 0;
+	}
+
+	bool open (string historyPath) {
+		path = historyPath;
+		if (!mapAtLeast(sizeof(Header) + 64*sizeof(MatchRecord))) {
+			return false;
+		}
+		if (header->magic[0] == 0 && header->count == 0) {
+			// new file
+			memcpy(header->magic, "BXHIST\0\0", 8);
+			header->version = 1;
+			header->recordSize = sizeof(MatchRecord);
+		} else if (memcmp(header->magic, "BXHIST\0\0", 8) != 0 || header->version != 1
+				|| header->recordSize != (int) sizeof(MatchRecord) || header->count > capacity) {
+			file.unmap();
+			return false;
+		}
+
+		players.clear();
+		ranking.clear();
+		for (int64 i = 0; i < header->count; i++) {
+			index(records[i]);
+		}
+		return true;
+	}
+
+	int64 count () const {
+		return header ? header->count : 0;
+	}
+
+	bool add (const MatchRecord &match) {
+		if (header->count == capacity
+				&& !mapAtLeast(sizeof(Header) + 2*capacity*sizeof(MatchRecord))) {
+			return false;
+		}
+		records[header->count] = match;
+		header->count++;	// only after the record is complete
+		file.flush();
+		index(match);
+		return true;
+	}
+
+	PlayerStats stats (string name) const {
+		unordered_map<string, PlayerStats>::const_iterator it = players.find(name);
+		if (it == players.end()) {
+			PlayerStats none = { 0, 0, 0 };
+			return none;
+		}
+		return it->second;
+	}
+
+	// The n players with the most wins, most first (ties by name)
+	vector<pair<string, PlayerStats> > top (int n) const {
+		vector<pair<string, PlayerStats> > leaders;
+		for (set<pair<int, string> >::const_iterator it = ranking.begin();
+				it != ranking.end() && (int) leaders.size() < n; ++it) {
+			leaders.push_back(make_pair(it->second, players.at(it->second)));
+		}
+		return leaders;
+	}
+
+	// Bring in the old winners.txt, one winner per line: those matches only know their winner
+	int importWinners (string textPath) {
+		FILE *text = fopen(textPath.c_str(), "r");
+		if (text == NULL) {
+			return 0;
+		}
+		int imported = 0;
+		char line[256];
+		while (fgets(line, sizeof(line), text) != NULL) {
+			string name = line;
+			name.erase(name.find_last_not_of(" \r\n\t") + 1);
+			if (name.empty()) {
+				continue;
+			}
+			MatchRecord match;
+			memset(&match, 0, sizeof(match));
+			copyName(match.player1, name);
+			copyName(match.winner, name);
+			if (!add(match)) {
+				break;
+			}
+			imported++;
+		}
+		fclose(text);
+		return imported;
+	}
+
+	static void copyName (char field[MatchRecord::NAME_LEN], string name) {
+		memset(field, 0, MatchRecord::NAME_LEN);
+		name.copy(field, MatchRecord::NAME_LEN - 1);
+	}
+
+private:
+	bool mapAtLeast (size_t bytes) {
+		if (!file.map(path, bytes)) {
+			header = NULL;
+			records = NULL;
+			capacity = 0;
+			return false;
+		}
+		header = (Header *) file.data;
+		records = (MatchRecord *) (file.data + sizeof(Header));
+		capacity = (file.size - sizeof(Header))/sizeof(MatchRecord);
+		return true;
+	}
+
+	// Count one match in its players' totals, moving the winner up the ranking
+	void index (const MatchRecord &match) {
+		string winner(match.winner, strnlen(match.winner, MatchRecord::NAME_LEN));
+		const char *names[] = { match.player1, match.player2 };
+		for (int p = 0; p < 2; p++) {
+			string name(names[p], strnlen(names[p], MatchRecord::NAME_LEN));
+			if (name.empty()) {
+				continue;
+			}
+			PlayerStats &player = entry(name);
+			player.played++;
+			if (name == winner) {
+				ranking.erase(make_pair(-player.wins, name));
+				player.wins++;
+				ranking.insert(make_pair(-player.wins, name));
+			} else if (!winner.empty()) {
+				player.losses++;
+			}
+		}
+	}
+
+	PlayerStats &entry (string name) {
+		unordered_map<string, PlayerStats>::iterator it = players.find(name);
+		if (it == players.end()) {
+			PlayerStats none = { 0, 0, 0 };
+			it = players.insert(make_pair(name, none)).first;
+			ranking.insert(make_pair(0, name));
+		}
+		return it->second;
+	}
+};
+
+	// Heap allocation counters, to check that the game loop stops allocating once it runs:
+	// every operator new of the program, and every Mat buffer (OpenCV allocates those itself)
+atomic<long long> newCalls(0);
+atomic<long long> matAllocations(0);
+
+void *operator new (size_t size) {
+	newCalls++;
+	void *p = malloc(size ? size : 1);
+	if (p == NULL) {
+		throw bad_alloc();
+	}
+	return p;
+}
+
+void operator delete (void *p) noexcept {
+	free(p);
+}
+
+	// Counts the Mat buffers allocated through it and leaves the work to OpenCV's own allocator
+class CountingMatAllocator: public MatAllocator {
+public:
+	UMatData *allocate (int dims, const int *sizes, int type, void *data, size_t *step,
+			int flags, UMatUsageFlags usageFlags) const {
+		if (data == NULL) { // otherwise the Mat wraps memory it does not own
+			matAllocations++;
+		}
+		return Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+	}
+	bool allocate (UMatData *data, int accessFlags, UMatUsageFlags usageFlags) const {
+		return Mat::getStdAllocator()->allocate(data, accessFlags, usageFlags);
+	}
+	void deallocate (UMatData *data) const {
+		Mat::getStdAllocator()->deallocate(data);
+	}
+};
+
+	// Allocations made since the last reset()
+struct AllocationCount {
+	long long newStart, matStart;
+
+	AllocationCount () {
+		reset();
+	}
+	void reset () {
+		newStart = newCalls;
+		matStart = matAllocations;
+	}
+	long long news () const {
+		return newCalls - newStart;
+	}
+	long long mats () const {
+		return matAllocations - matStart;
+	}
+};
+
+	// Frame time samples of one stage of the game loop, for the benchmark
+class StageTimes {
+public:
+	string name;
+	vector<double> ms;
+
+	StageTimes (string set_name) {
+		name = set_name;
+	}
+	void add (int64 ticks) {
+		ms.push_back(ticks*1000.0/getTickFrequency());
+	}
+	// p-th percentile (nearest rank) of the samples, in milliseconds
+	double percentile (double p) {
+		if (ms.empty()) {
+			return 0.0;
+		}
+		vector<double> sorted = ms;
+		sort(sorted.begin(), sorted.end());
+		int rank = (int) ceil(p/100.0*sorted.size()) - 1;
+		return sorted[max(0, min((int) sorted.size() - 1, rank))];
+	}
+	double mean () {
+		double sum = 0.0;
+		for (size_t i = 0; i < ms.size(); i++) {
+			sum += ms[i];
+		}
+		return ms.empty() ? 0.0 : sum/ms.size();
+	}
+};
+
+// Name of the instruction set the fused colour kernel was built for
+const char *simdName () {
+#if defined(__AVX2__)
+	return "avx2";
+#elif defined(__SSSE3__)
+	return "ssse3";
+#else
+	return "scalar";
+#endif
+}
+
+// Drive the tracking and drawing pipeline over synthetic frames at several resolutions and
+// report p50/p99 time per stage and overall FPS, as a table and as JSON in "reportPath".
+// The stages run one after the other on this thread so that each can be timed on its own.
+int runBenchmark (int frames, bool headless, const TrackerOptions &tracking, double punchSpeed,
+		bool fullRedraw, string reportPath) {
+	int sizes[][2] = { {640, 480}, {1280, 720}, {1920, 1080}, {3840, 2160} };
+	GameSettings settings;	// the synthetic players wear the default colours
+	settings.tracking = tracking;
+	FILE *report = fopen(reportPath.c_str(), "w");
+	if (report == NULL) {
+		printf("Cannot write %s\n", reportPath.c_str());
+		return 1;
+	}
+
+	fprintf(report, "{\n  \"simd\": \"%s\",\n  \"colour_path\": \"%s\",\n  \"render\": \"%s\",\n"
+			"  \"search\": \"%s\",\n  \"pyramid\": {\"head\": %d, \"fists\": %d},\n  \"blobs\": %s,\n"
+			"  \"punch_speed\": %.2f,\n  \"frames\": %d,\n  \"results\": [\n",
+			simdName(), tracking.labels ? (tracking.roiOnly ? "roi_labels" : "full_frame_labels")
+			: tracking.fused ? "fused" : tracking.roiOnly ? "roi_mask" : "full_frame_mask",
+			fullRedraw ? "full" : "dirty_rects", tracking.predictive ? "predictive" : "roi",
+			tracking.headLevel, tracking.fistLevel, tracking.blobs ? "true" : "false", punchSpeed, frames);
+
+	for (int r = 0; r < 4; r++) {
+		int cols = sizes[r][0], rows = sizes[r][1];
+		SyntheticSource source1(cols, rows, 1, punchSpeed), source2(cols, rows, 2, punchSpeed);
+		Mat frame, frame2;
+		BufferPool buffers(rows, cols, 6, 6);
+		Mat game = buffers.take(CV_8UC3);
+		Mat game2 = buffers.take(CV_8UC3);
+		Physics physics;
+		moTracker p1(physics, Physics::P1), p1LHand(physics, Physics::P1L), p1RHand(physics, Physics::P1R);
+		moTracker p2(physics, Physics::P2), p2LHand(physics, Physics::P2L), p2RHand(physics, Physics::P2R);
+		CameraCache camera1, camera2;
+		GameRenderer renderer("Player1", "Player2");
+		AllocationCount allocations;
+
+		source1.read(frame);
+		source2.read(frame2);
+		buffers.adopt(frame);
+		buffers.adopt(frame2);
+		camera1.masks.useBuffers(buffers);
+		camera2.masks.useBuffers(buffers);
+		camera1.masks.useClasses(settings.classifier());
+		camera2.masks.useClasses(settings.classifier());
+		renderer.useBuffers(buffers);
+		setupPlayers(frame, frame2, settings, p1, p1LHand, p1RHand, p2, p2LHand, p2RHand);
+		physics.separateOwn = !tracking.blobs;
+
+		vector<StageTimes> stages;
+		const char *names[] = { "capture", "feedNewframe", "separate", "updateROI", "drawROI",
+				"drawPlayer", "labels", "imshow", "total" };
+		for (int i = 0; i < 9; i++) {
+			stages.push_back(StageTimes(names[i]));
+			stages[i].ms.reserve(frames);
+		}
+		int64 runStart = getTickCount();
+
+		for (int n = 0; n < frames; n++) {
+			int64 t[10];
+			t[0] = getTickCount();
+			source1.read(frame);
+			source2.read(frame2);
+			t[1] = getTickCount();
+			feedPlayer(frame, n, camera1, settings, p1, p1LHand, p1RHand);
+			feedPlayer(frame2, n, camera2, settings, p2, p2LHand, p2RHand);
+			t[2] = getTickCount();
+			physics.resolveCollisions(frame.cols, frame.rows);
+			t[3] = getTickCount();
+			updatePlayerROI(frame, p1, p1LHand, p1RHand);
+			updatePlayerROI(frame2, p2, p2LHand, p2RHand);
+			t[4] = getTickCount();
+			drawPlayerROI(frame, p1, p1LHand, p1RHand);
+			drawPlayerROI(frame2, p2, p2LHand, p2RHand);
+			t[5] = getTickCount();
+			if (fullRedraw) {
+				drawGame(game, game2, p1, p1LHand, p1RHand, p2, p2LHand, p2RHand);
+			} else {
+				renderer.drawScene(game, game2, p1, p1LHand, p1RHand, p2, p2LHand, p2RHand);
+			}
+			t[6] = getTickCount();
+			if (fullRedraw) {
+				labelViews(game, game2, "Player1", "Player2");
+			} else {
+				renderer.finishViews(game, game2);
+			}
+			t[7] = getTickCount();
+			if (!headless) {
+				imshow("Player 1 ROI", frame);
+				imshow("Player 2 ROI", frame2);
+				imshow("Boxing Game 1", game);
+				imshow("Boxing Game 2", game2);
+				waitKey(1);
+			}
+			t[8] = getTickCount();
+
+			for (int i = 0; i < 8; i++) {
+				stages[i].add(t[i + 1] - t[i]);
+			}
+			stages[8].add(t[8] - t[0]);
+			if (n == 0) {
+				allocations.reset(); // the first frame sets up masks and layers
+			}
+		}
+		int steadyFrames = max(1, frames - 1);
+		double newsPerFrame = (double) allocations.news()/steadyFrames;
+		double matsPerFrame = (double) allocations.mats()/steadyFrames;
+		double seconds = (getTickCount() - runStart)/getTickFrequency();
+		double fps = seconds > 0.0 ? frames/seconds : 0.0;
+
+		// Colour search cost and quality over the six trackers
+		moTracker *trackers[] = { &p1, &p1LHand, &p1RHand, &p2, &p2LHand, &p2RHand };
+		int64 searched = 0, lost = 0;
+		for (int i = 0; i < 6; i++) {
+			searched += trackers[i]->pixelsThresholded;
+			lost += trackers[i]->lostFrames;
+		}
+		double searchedPerFrame = (double) searched/max(1, frames);
+
+		// Pixels the render stages write per frame: the full redraw clears both whole views
+		double renderPixels = fullRedraw ? 2.0*cols*rows
+				: renderer.frames ? (double) renderer.pixelsWritten/renderer.frames : 0.0;
+
+		printf("%dx%d: %.1f FPS, %.0f pixels rendered/frame, %.2f heap allocations/frame (%.2f Mat buffers)\n",
+				cols, rows, fps, renderPixels, newsPerFrame + matsPerFrame, matsPerFrame);
+		printf("  colour search: %.0f pixels/frame, %lld lost tracker frames\n", searchedPerFrame, (long long) lost);
+		printf("  %-14s %10s %10s %10s\n", "stage", "p50 ms", "p99 ms", "mean ms");
+		fprintf(report, "    {\"resolution\": \"%dx%d\", \"fps\": %.2f, \"render_pixels_per_frame\": %.0f,\n"
+				"     \"new_per_frame\": %.3f, \"mat_allocations_per_frame\": %.3f,\n"
+				"     \"search_pixels_per_frame\": %.0f, \"lost_tracker_frames\": %lld, \"stages\": {\n",
+				cols, rows, fps, renderPixels, newsPerFrame, matsPerFrame, searchedPerFrame, (long long) lost);
+		for (size_t i = 0; i < stages.size(); i++) {
+			if (headless && stages[i].name == "imshow") {
+				continue;
+			}
+			printf("  %-14s %10.3f %10.3f %10.3f\n", stages[i].name.c_str(),
+					stages[i].percentile(50), stages[i].percentile(99), stages[i].mean());
+			fprintf(report, "      \"%s\": {\"p50_ms\": %.4f, \"p99_ms\": %.4f, \"mean_ms\": %.4f}%s\n",
+					stages[i].name.c_str(), stages[i].percentile(50), stages[i].percentile(99),
+					stages[i].mean(), i + 1 < stages.size() ? "," : "");
+		}
+		fprintf(report, "    }}%s\n", r < 3 ? "," : "");
+	}
+
+	fprintf(report, "  ]\n}\n");
+	fclose(report);
+	printf("Report written to %s\n", reportPath.c_str());
+	return 0;
+}
+
+// Replay a match from its event log, unpaced: either re-render it ("render", showing the game windows
+// unless headless) or only re-score it, recomputing hits and stamina from the recorded touch flags
+// and checking them against what the game recorded. Returns the number of frames that disagree.
+int runReplay (string path, const GameSettings &settings, bool render, bool headless) {
+	EventReader log;
+	if (!log.open(path)) {
+		printf("Cannot read event log %s\n", path.c_str());
+		return -1;
+	}
+
+	Mat blank = Mat::zeros(log.rows, log.cols, CV_8UC3);
+	Mat game = Mat (log.rows, log.cols, CV_8UC3);
+	Mat game2 = Mat (log.rows, log.cols, CV_8UC3);
+	Physics physics;
+	moTracker p1(physics, Physics::P1), p1LHand(physics, Physics::P1L), p1RHand(physics, Physics::P1R);
+	moTracker p2(physics, Physics::P2), p2LHand(physics, Physics::P2L), p2RHand(physics, Physics::P2R);
+	moTracker *trackers[] = { &p1, &p1LHand, &p1RHand, &p2, &p2LHand, &p2RHand };
+	GameRenderer renderer(log.name1, log.name2);
+	setupPlayers(blank, blank, settings, p1, p1LHand, p1RHand, p2, p2LHand, p2RHand);
+	for (int i = 0; i < Physics::N; i++) {
+		trackers[i]->prepare(blank);
+	}
+
+	// What the game recorded, to compare the replay with
+	int recHit[2] = { 0, 0 }, recHitNo[2] = { 0, 0 }, recBar[2] = { p1.wBar, p2.wBar };
+	moTracker *players[] = { &p1, &p2 };
+	EventReader::Record r;
+	bool pending = false;	// a frame has been read and not replayed yet
+	int frames = 0, mismatches = 0;
+	int64 lastMicros = 0;
+	string winner;
+	int64 start = getTickCount();
+
+	while (true) {
+		bool more = log.next(r);
+		if (pending && (!more || r.type == EVENT_FRAME || r.type == EVENT_END)) {
+			// All of the previous frame's records are in: replay it, as the game did, until one player is out
+			if (p1.wBar != 0 && p2.wBar != 0) {
+				if (render) {
+					renderer.drawScene(game, game2, p1, p1LHand, p1RHand, p2, p2LHand, p2RHand);
+					renderer.finishViews(game, game2);
+					if (!headless) {
+						imshow("Boxing Game 1", game);
+						imshow("Boxing Game 2", game2);
+						waitKey(1);
+					}
+				} else {
+					p1.updateStamina(log.cols, p2LHand, p2RHand);
+					p2.updateStamina(log.cols, p1LHand, p1RHand);
+				}
+			}
+			for (int p = 0; p < 2; p++) {
+				if ((players[p]->hit ? 1 : 0) != recHit[p] || players[p]->hitNo != recHitNo[p]
+						|| players[p]->wBar != recBar[p]) {
+					mismatches++;
+					break;
+				}
+			}
+			frames++;
+			pending = false;
+		}
+		if (!more) {
+			break;
+		}
+
+		switch (r.type) {
+		case EVENT_FRAME:
+			for (int i = 0; i < Physics::N; i++) {
+				physics.xCOM[i] = r.xCOM[i];
+				physics.yCOM[i] = r.yCOM[i];
+			}
+			lastMicros = r.micros;
+			pending = true;
+			break;
+		case EVENT_TOUCH:
+			if (r.who < Physics::N) {
+				physics.isTouching[r.who] = r.value != 0;
+			}
+			break;
+		case EVENT_HIT:
+			recHit[r.who & 1] = r.value;
+			break;
+		case EVENT_HITNO:
+			recHitNo[r.who & 1] = r.value;
+			break;
+		case EVENT_BAR:
+			recBar[r.who & 1] = r.value;
+			break;
+		case EVENT_END:
+			winner = r.winner;
+			break;
+		}
+	}
+
+	double seconds = (getTickCount() - start)/getTickFrequency();
+	printf("Replayed %d frames of %s (%s vs %s) in %.3f s, %.0fx real time (%s)\n",
+			frames, path.c_str(), log.name1.c_str(), log.name2.c_str(), seconds,
+			seconds > 0.0 ? lastMicros/1e6/seconds : 0.0, render ? "re-rendered" : "re-scored");
+	printf("Hits: %s %d, %s %d; winner \"%s\"; %d frames disagree with the log\n",
+			log.name1.c_str(), p1.hitNo, log.name2.c_str(), p2.hitNo, winner.c_str(), mismatches);
+	return mismatches;
+}
+
+// Decimal text of "n" (std::to_string is missing from some MinGW builds)
+string intText (int n) {
+	char text[16];
+	snprintf(text, sizeof(text), "%d", n);
+	return text;
+}
+
+	// One recorded match of the tuning corpus: both players' sources and, when the game logged it,
+	// the hits each player took according to its event log, which the candidates are scored against
+struct TuneMatch {
+	string source1, source2;
+	string logPath;
+	int refTaken[2];	// -1 without a log
+};
+
+	// One point of the sweep
+struct TuneCandidate {
+	GameSettings settings;
+	string label;		// the swept "key=value" pairs
+};
+
+	// What one candidate did on one match
+struct TuneResult {
+	int frames;
+	int64 lost;		// tracker frames without any of the colour
+	double jitter;		// sum of |COM - 2 COM' + COM''| over trackers and frames
+	int taken[2];		// hits each player took
+};
+
+	// The game's tracking and hit logic for one candidate on one match, without windows or rendering.
+	// Each run has its own trackers and camera caches, so runs can share the decoded frames.
+class TuneRun {
+public:
+	const GameSettings &settings;
+	Physics physics;
+	moTracker p1, p1LHand, p1RHand;
+	moTracker p2, p2LHand, p2RHand;
+	moTracker *trackers[Physics::N];
+	CameraCache camera1, camera2;
+	int xLast[Physics::N][2], yLast[Physics::N][2];	// the previous two COMs, for the jitter
+	TuneResult result;
+
+	TuneRun (const GameSettings &set_settings, Mat frame, Mat frame2) : settings(set_settings),
+			p1(physics, Physics::P1), p1LHand(physics, Physics::P1L), p1RHand(physics, Physics::P1R),
+			p2(physics, Physics::P2), p2LHand(physics, Physics::P2L), p2RHand(physics, Physics::P2R) {
+		moTracker *all[] = { &p1, &p1LHand, &p1RHand, &p2, &p2LHand, &p2RHand };
+		for (int i = 0; i < Physics::N; i++) {
+			trackers[i] = all[i];
+		}
+		camera1.masks.useClasses(settings.classifier());
+		camera2.masks.useClasses(settings.classifier());
+		setupPlayers(frame, frame2, settings, p1, p1LHand, p1RHand, p2, p2LHand, p2RHand);
+		physics.separateOwn = !settings.tracking.blobs;
+		memset(&result, 0, sizeof(result));
+	}
+
+	// One frame, as the game loop does it; stamina stops once a player is out
+	void step (Mat frame, Mat frame2, int frameNo) {
+		feedPlayer(frame, frameNo, camera1, settings, p1, p1LHand, p1RHand);
+		feedPlayer(frame2, frameNo, camera2, settings, p2, p2LHand, p2RHand);
+		physics.resolveCollisions(frame.cols, frame.rows);
+		updatePlayerROI(frame, p1, p1LHand, p1RHand);
+		updatePlayerROI(frame2, p2, p2LHand, p2RHand);
+		if (p1.wBar != 0 && p2.wBar != 0) {
+			p1.updateStamina(frame.cols, p2LHand, p2RHand);
+			p2.updateStamina(frame.cols, p1LHand, p1RHand);
+		}
+
+		for (int i = 0; i < Physics::N; i++) {
+			int x = physics.xCOM[i], y = physics.yCOM[i];
+			if (result.frames >= 2) {
+				result.jitter += abs(x - 2*xLast[i][0] + xLast[i][1]) + abs(y - 2*yLast[i][0] + yLast[i][1]);
+			}
+			xLast[i][1] = xLast[i][0];
+			yLast[i][1] = yLast[i][0];
+			xLast[i][0] = x;
+			yLast[i][0] = y;
+		}
+		result.frames++;
+	}
+
+	TuneResult finish () {
+		for (int i = 0; i < Physics::N; i++) {
+			result.lost += trackers[i]->lostFrames;
+		}
+		result.taken[0] = p1.hitsTaken;
+		result.taken[1] = p2.hitsTaken;
+		return result;
+	}
+};
+
+// Decode one match once and run candidates [first, last) over it, at most "maxFrames" frames.
+// Results go to results[c]. False if the match cannot be read.
+bool tuneMatch (const TuneMatch &match, const vector<TuneCandidate> &candidates, int first, int last,
+		int maxFrames, TuneResult *results) {
+	FrameSource *source1 = openSource(match.source1, 1);
+	FrameSource *source2 = openSource(match.source2, 2);
+	Mat frame, frame2;
+	bool ok = source1 != NULL && source2 != NULL && source1->isOpened() && source2->isOpened()
+			&& !source1->live() && !source2->live() && source1->read(frame) && source2->read(frame2);
+
+	if (ok) {
+		vector<TuneRun *> runs;
+		for (int c = first; c < last; c++) {
+			runs.push_back(new TuneRun(candidates[c].settings, frame, frame2));
+		}
+		for (int n = 0; n < maxFrames; n++) {
+			if (n > 0 && (!source1->read(frame) || !source2->read(frame2))) {
+				break;
+			}
+			for (size_t r = 0; r < runs.size(); r++) {
+				runs[r]->step(frame, frame2, n);
+			}
+		}
+		for (size_t r = 0; r < runs.size(); r++) {
+			results[first + r] = runs[r]->finish();
+			delete runs[r];
+		}
+	}
+	delete source1;
+	delete source2;
+	return ok;
+}
+
+// Hits each player took in an event log: every rise of their hit count. False if it cannot be read.
+bool loggedHits (string path, int taken[2]) {
+	EventReader log;
+	if (!log.open(path)) {
+		return false;
+	}
+	int hitNo[2] = { 0, 0 };
+	taken[0] = taken[1] = 0;
+	EventReader::Record r;
+	while (log.next(r)) {
+		if (r.type == EVENT_HITNO) {
+			int p = r.who & 1;
+			if (r.value > hitNo[p]) {
+				taken[p] += r.value - hitNo[p];
+			}
+			hitNo[p] = r.value;
+		}
+	}
+	return true;
+}
+
+// Read the tuning corpus: one match per line, "SOURCE1 SOURCE2 [EVENTLOG]" with sources as for
+// "-source1", e.g. "video:night/m1_cam1.avi video:night/m1_cam2.avi night/m1.log"; # starts a comment
+bool loadCorpus (string path, vector<TuneMatch> &matches, string &error) {
+	FILE *file = fopen(path.c_str(), "r");
+	if (file == NULL) {
+		error = "cannot open " + path;
+		return false;
+	}
+	char text[1024];
+	int lineNo = 0;
+	while (fgets(text, sizeof(text), file) != NULL) {
+		lineNo++;
+		string line = text;
+		line = line.substr(0, line.find_first_of("#\r\n"));
+		char spec1[512], spec2[512], log[512];
+		int n = sscanf(line.c_str(), "%511s %511s %511s", spec1, spec2, log);
+		if (n <= 0) {
+			continue;
+		}
+		TuneMatch match;
+		match.refTaken[0] = match.refTaken[1] = -1;
+		if (n >= 2) {
+			match.source1 = spec1;
+			match.source2 = spec2;
+		}
+		if (n == 3) {
+			match.logPath = log;
+		}
+		if (n < 2 || (n == 3 && !loggedHits(match.logPath, match.refTaken))) {
+			fclose(file);
+			error = path + " line " + intText(lineNo) + ": cannot use \"" + line + "\"";
+			return false;
+		}
+		matches.push_back(match);
+	}
+	fclose(file);
+	if (matches.empty()) {
+		error = path + " lists no matches";
+		return false;
+	}
+	return true;
+}
+
+// Every combination of the swept values over "base". Each sweep is "key=v1,v2,..." with keys and
+// values as in the settings file, e.g. "head_size=120,150,180" or "fist_darker=0 150 150,0 164 164".
+// Combinations the settings do not allow (darker above brighter, ...) are left out.
+bool expandSweeps (const GameSettings &base, const vector<string> &sweeps, vector<TuneCandidate> &candidates,
+		string &error) {
+	TuneCandidate start;
+	start.settings = base;
+	candidates.assign(1, start);
+
+	for (size_t s = 0; s < sweeps.size(); s++) {
+		size_t eq = sweeps[s].find('=');
+		if (eq == string::npos) {
+			error = "cannot use sweep \"" + sweeps[s] + "\"";
+			return false;
+		}
+		string key = sweeps[s].substr(0, eq);
+		vector<string> values;
+		size_t from = eq + 1;
+		while (from <= sweeps[s].size()) {
+			size_t comma = min(sweeps[s].find(',', from), sweeps[s].size());
+			values.push_back(sweeps[s].substr(from, comma - from));
+			from = comma + 1;
+		}
+
+		vector<TuneCandidate> grown;
+		for (size_t c = 0; c < candidates.size(); c++) {
+			for (size_t v = 0; v < values.size(); v++) {
+				TuneCandidate next = candidates[c];
+				if (!next.settings.assign(key, values[v])) {
+					error = "cannot use sweep value \"" + key + "=" + values[v] + "\"";
+					return false;
+				}
+				next.label += (next.label.empty() ? "" : "; ") + key + "=" + values[v];
+				grown.push_back(next);
+			}
+		}
+		candidates.swap(grown);
+	}
+
+	vector<TuneCandidate> valid;
+	for (size_t c = 0; c < candidates.size(); c++) {
+		string why;
+		if (candidates[c].settings.validate(why)) {
+			valid.push_back(candidates[c]);
+		}
+	}
+	candidates.swap(valid);
+	if (candidates.empty()) {
+		error = "no combination of the sweeps gives valid settings";
+		return false;
+	}
+	return true;
+}
+
+// Batch re-scoring and threshold tuning: run every candidate of the sweep over every match of the
+// corpus, headless and spread over "workers" threads (0 runs everything here), and rank them.
+// Candidates that get the logged hits right come first, then those that lose the colours least,
+// then the steadiest. Each job decodes its match once for a slice of the candidates, and there are
+// about two jobs per worker. Writes one CSV line per candidate to "reportPath".
+int runTuning (string corpusPath, const GameSettings &base, const vector<string> &sweeps, int maxFrames,
+		int workers, string reportPath) {
+	vector<TuneMatch> matches;
+	vector<TuneCandidate> candidates;
+	string error;
+	if (!loadCorpus(corpusPath, matches, error) || !expandSweeps(base, sweeps, candidates, error)) {
+		printf("Tuning: %s\n", error.c_str());
+		return -1;
+	}
+	int nMatches = (int) matches.size(), nCandidates = (int) candidates.size();
+	bool referenced = false;
+	for (int m = 0; m < nMatches; m++) {
+		referenced = referenced || matches[m].refTaken[0] >= 0;
+	}
+
+	// Candidates are split into slices so that small corpora still keep every worker busy
+	int slices = min(nCandidates, max(1, (2*max(workers, 1) + nMatches - 1)/nMatches));
+	int sliceSize = (nCandidates + slices - 1)/slices;
+	vector<TuneResult> results((size_t) nMatches*nCandidates);
+	vector<char> readable(nMatches*slices, 1);
+	vector<function<void()> > jobs;
+	jobs.reserve(nMatches*slices);	// the pool keeps pointers to the jobs
+	for (int m = 0; m < nMatches; m++) {
+		for (int j = 0; j < slices; j++) {
+			int first = j*sliceSize, last = min(nCandidates, first + sliceSize);
+			if (first >= last) {
+				continue;
+			}
+			TuneResult *row = &results[(size_t) m*nCandidates];
+			char *ok = &readable[m*slices + j];
+			const TuneMatch *match = &matches[m];
+			jobs.push_back([match, &candidates, first, last, maxFrames, row, ok] {
+				*ok = tuneMatch(*match, candidates, first, last, maxFrames, row);
+			});
+		}
+	}
+
+	printf("Tuning %d candidates on %d matches: %d jobs on %d workers\n", nCandidates, nMatches,
+			(int) jobs.size(), workers);
+	int64 start = getTickCount();
+	{
+		WorkerPool pool(workers);
+		for (size_t j = 0; j < jobs.size(); j++) {
+			if (workers == 0) {
+				jobs[j]();
+			} else {
+				pool.submit(jobs[j]);
+			}
+		}
+		pool.wait();
+	}
+	double seconds = (getTickCount() - start)/getTickFrequency();
+
+	for (int m = 0; m < nMatches; m++) {
+		if (!readable[m*slices]) {
+			printf("Tuning: cannot read %s / %s (recorded sources only)\n",
+					matches[m].source1.c_str(), matches[m].source2.c_str());
+			return -1;
+		}
+	}
+
+	// Totals of each candidate over the corpus
+	struct Score {
+		int candidate;
+		int64 frames, lost;
+		double jitter;
+		int hitError;		// over the matches with a log
+		int taken;
+	};
+	vector<Score> scores(nCandidates);
+	int64 trackedFrames = 0;
+	for (int c = 0; c < nCandidates; c++) {
+		Score &sc = scores[c];
+		memset(&sc, 0, sizeof(sc));
+		sc.candidate = c;
+		for (int m = 0; m < nMatches; m++) {
+			const TuneResult &r = results[(size_t) m*nCandidates + c];
+			sc.frames += r.frames;
+			sc.lost += r.lost;
+			sc.jitter += r.jitter;
+			sc.taken += r.taken[0] + r.taken[1];
+			for (int p = 0; p < 2; p++) {
+				if (matches[m].refTaken[p] >= 0) {
+					sc.hitError += abs(r.taken[p] - matches[m].refTaken[p]);
+				}
+			}
+		}
+		trackedFrames += sc.frames;
+	}
+	sort(scores.begin(), scores.end(), [] (const Score &a, const Score &b) {
+		if (a.hitError != b.hitError) {
+			return a.hitError < b.hitError;
+		}
+		double lostA = (double) a.lost/max((int64) 1, a.frames), lostB = (double) b.lost/max((int64) 1, b.frames);
+		if (lostA != lostB) {
+			return lostA < lostB;
+		}
+		return a.jitter/max((int64) 1, a.frames) < b.jitter/max((int64) 1, b.frames);
+	});
+
+	FILE *report = fopen(reportPath.c_str(), "w");
+	if (report != NULL) {
+		fprintf(report, "rank,settings,frames,lost_tracker_frames_pct,jitter_px_per_tracker_frame,hits_taken,hit_error\n");
+	}
+	for (int k = 0; k < nCandidates; k++) {
+		const Score &sc = scores[k];
+		double frames = (double) max((int64) 1, sc.frames);
+		double lostPct = 100.0*sc.lost/(Physics::N*frames), jitter = sc.jitter/(Physics::N*frames);
+		string label = candidates[sc.candidate].label.empty() ? "(settings file)" : candidates[sc.candidate].label;
+		if (report != NULL) {
+			fprintf(report, "%d,\"%s\",%lld,%.3f,%.3f,%d,", k + 1, label.c_str(), (long long) sc.frames,
+					lostPct, jitter, sc.taken);
+			if (referenced) {
+				fprintf(report, "%d", sc.hitError);
+			}
+			fprintf(report, "\n");
+		}
+		if (k < 5) {
+			printf("%2d. %s: %.2f%% lost, %.2f px jitter, %d hits", k + 1, label.c_str(), lostPct, jitter, sc.taken);
+			if (referenced) {
+				printf(", %d off the logs", sc.hitError);
+			}
+			printf("\n");
+		}
+	}
+	if (report != NULL) {
+		fclose(report);
+		printf("Report written to %s\n", reportPath.c_str());
+	} else {
+		printf("Cannot write %s\n", reportPath.c_str());
+	}
+
+	// A tracked frame is both players' cameras through one candidate; a slice shares the decoding
+	double fps = seconds > 0.0 ? trackedFrames/seconds : 0.0;
+	// (the rate per worker is the total shared out, not a measurement of each worker)
+	printf("Tracked %lld candidate frames in %.2f s: %.0f frames/s, %.0f frames/s per worker (%d worker%s)\n",
+			(long long) trackedFrames, seconds, fps, fps/max(workers, 1), max(workers, 1), workers > 1 ? "s" : "");
+	return 0;
+}
+
+// The trigonometric separation the game used before Physics::resolve (sqrt/pow, acos, cos, sin),
+// kept only so the micro-benchmark can compare against it. Divides by zero on coincident centres.
+void legacyResolve (Physics &ph, const Physics::Contact &c, int cols, int rows) {
+	int i = c.moved, ref = c.ref;
+	double delX = 0.0, delY = 0.0, rDist = c.rDist;
+	double alpha = 0.0;
+	int p2Factor = i >= Physics::P2 ? -1 : 1;
+
+	if (c.cross) {
+		delX = p2Factor*((ph.xCOM[i] + ph.xCOM[ref]) - cols);
+		delY = p2Factor*((ph.yCOM[i] + ph.yCOM[ref]) - rows);
+	} else {
+		delX = ph.xCOM[i] - ph.xCOM[ref];
+		delY = ph.yCOM[i] - ph.yCOM[ref];
+	}
+	int dist = round(sqrt(pow(delX, 2.0) + pow (delY, 2.0)));
+
+	if (dist < rDist) {
+		alpha = acos ((double) (delX/dist));
+		if (delY < 0) {
+			alpha = -alpha;
+		}
+		if (c.cross) {
+			ph.xCOM[i] = (int) (cols - ph.xCOM[ref] + p2Factor*cos(alpha)*rDist);
+			ph.yCOM[i] = (int) (rows - ph.yCOM[ref] + p2Factor*sin(alpha)*rDist);
+		} else {
+			ph.xCOM[i] = (int) (ph.xCOM[ref] + cos(alpha)*rDist);
+			ph.yCOM[i] = (int) (ph.yCOM[ref] + sin(alpha)*rDist);
+		}
+	}
+	if (dist > rDist - 10 && dist < rDist + 10 && c.hit) {
+		ph.isTouching[i] = true;
+	} else if (dist > (rDist + 30) && c.hit) {
+		ph.isTouching[i] = false;
+	}
+}
+
+// The game's collision steps before Physics::resolveCollisions, one call after another as it made them:
+// each player's own ROIs, then both players. Only for the micro-benchmark. Returns the contacts resolved.
+int legacyCollisions (Physics &ph, int cols, int rows) {
+	int n = 0;
+	for (int head = Physics::P1; head <= Physics::P2; head += Physics::P2) {
+		int lHand = head + 1, rHand = head + 2;
+		int headRad = ph.rad[head], handRad = ph.rad[rHand];
+		legacyResolve(ph, Physics::contact(lHand, head, headRad + handRad, false, false), cols, rows);
+		legacyResolve(ph, Physics::contact(rHand, head, headRad + handRad, false, false), cols, rows);
+		bool leftOfHead = head < Physics::P2 ? ph.xCOM[lHand] + handRad < ph.xCOM[head]
+				: ph.xCOM[head] + handRad < ph.xCOM[lHand];
+		if (leftOfHead) {
+			legacyResolve(ph, Physics::contact(rHand, lHand, 2*handRad, false, false), cols, rows);
+		} else {
+			legacyResolve(ph, Physics::contact(lHand, rHand, 2*handRad, false, false), cols, rows);
+		}
+		n += 3;
+	}
+
+	int r1Head = ph.rad[Physics::P1], r1Hand = ph.rad[Physics::P1R];
+	int r2Head = ph.rad[Physics::P2], r2Hand = ph.rad[Physics::P2R];
+	if (ph.yCOM[Physics::P1L] - r1Hand >= rows/2) {
+		legacyResolve(ph, Physics::contact(Physics::P2L, Physics::P1L, r1Hand + r2Hand, true, false), cols, rows);
+		legacyResolve(ph, Physics::contact(Physics::P2R, Physics::P1L, r1Hand + r2Hand, true, false), cols, rows);
+		legacyResolve(ph, Physics::contact(Physics::P2L, Physics::P1R, r1Hand + r2Hand, true, false), cols, rows);
+		legacyResolve(ph, Physics::contact(Physics::P2R, Physics::P1R, r1Hand + r2Hand, true, false), cols, rows);
+	} else {
+		legacyResolve(ph, Physics::contact(Physics::P1L, Physics::P2L, r1Hand + r2Hand, true, false), cols, rows);
+		legacyResolve(ph, Physics::contact(Physics::P1R, Physics::P2L, r1Hand + r2Hand, true, false), cols, rows);
+		legacyResolve(ph, Physics::contact(Physics::P1L, Physics::P2R, r1Hand + r2Hand, true, false), cols, rows);
+		legacyResolve(ph, Physics::contact(Physics::P1R, Physics::P2R, r1Hand + r2Hand, true, false), cols, rows);
+	}
+	legacyResolve(ph, Physics::contact(Physics::P2L, Physics::P1, r1Head + r2Hand, true, true), cols, rows);
+	legacyResolve(ph, Physics::contact(Physics::P2R, Physics::P1, r1Head + r2Hand, true, true), cols, rows);
+	legacyResolve(ph, Physics::contact(Physics::P1L, Physics::P2, r2Head + r1Hand, true, true), cols, rows);
+	legacyResolve(ph, Physics::contact(Physics::P1R, Physics::P2, r2Head + r1Hand, true, true), cols, rows);
+	return n + 8;
+}
+
+// Micro-benchmark of Physics::resolveCollisions against the trigonometric code it replaced,
+// on random crowded scenes (no coincident centres, which the old code cannot handle)
+int runCollisionBench (int reps) {
+	const int cols = 640, rows = 480, nScenes = 1024;
+	vector<Physics> scenes(nScenes);
+	RNG rng(2017);
+
+	for (int k = 0; k < nScenes; k++) {
+		Physics &ph = scenes[k];
+		for (int i = 0; i < Physics::N; i++) {
+			bool head = i == Physics::P1 || i == Physics::P2;
+			ph.rad[i] = head ? 75 : 50;
+			ph.isTouching[i] = false;
+			ph.xCOM[i] = rng.uniform(cols/4, cols*3/4);
+			ph.yCOM[i] = rng.uniform(rows/4, rows*3/4);
+		}
+		// Move apart any two centres that coincide, as seen from either camera
+		for (int i = 0; i < Physics::N; i++) {
+			for (int j = 0; j < Physics::N; j++) {
+				if (i != j && ((ph.xCOM[i] == ph.xCOM[j] && ph.yCOM[i] == ph.yCOM[j])
+						|| (ph.xCOM[i] == cols - ph.xCOM[j] && ph.yCOM[i] == rows - ph.yCOM[j]))) {
+					ph.xCOM[i]++;
+				}
+			}
+		}
+	}
+
+	// Time both versions on identical copies of the scenes
+	vector<Physics> fast, slow;
+	int64 contacts = 0, fastTicks = 0, slowTicks = 0;
+	for (int r = 0; r < reps; r++) {
+		fast = scenes;
+		int64 t0 = getTickCount();
+		for (int k = 0; k < nScenes; k++) {
+			fast[k].resolveCollisions(cols, rows);
+		}
+		fastTicks += getTickCount() - t0;
+
+		slow = scenes;
+		t0 = getTickCount();
+		for (int k = 0; k < nScenes; k++) {
+			contacts += legacyCollisions(slow[k], cols, rows);
+		}
+		slowTicks += getTickCount() - t0;
+	}
+
+	// How far apart the two versions end up (the old one rounds the distance before normalising)
+	int maxDiff = 0, touchDiffs = 0;
+	for (int k = 0; k < nScenes; k++) {
+		for (int i = 0; i < Physics::N; i++) {
+			maxDiff = max(maxDiff, abs(fast[k].xCOM[i] - slow[k].xCOM[i]));
+			maxDiff = max(maxDiff, abs(fast[k].yCOM[i] - slow[k].yCOM[i]));
+			touchDiffs += fast[k].isTouching[i] != slow[k].isTouching[i];
+		}
+	}
+
+	double fastNs = fastTicks*1e9/getTickFrequency()/contacts;
+	double slowNs = slowTicks*1e9/getTickFrequency()/contacts;
+	printf("Collision resolution over %lld contacts:\n", (long long) contacts);
+	printf("  trigonometric: %.2f ns/contact\n", slowNs);
+	printf("  trig-free:     %.2f ns/contact (%.2fx)\n", fastNs, fastNs > 0.0 ? slowNs/fastNs : 0.0);
+	printf("  largest position difference %d px, %d touch flags differ\n", maxDiff, touchDiffs);
+	return 0;
+}
+
+// Compare bandMoments with the original inRange + COM loop on random frames.
+// Returns the number of mismatching windows.
+int checkKernel () {
+	RNG rng(2017);
+	int failures = 0, checks = 0;
+	int sizes[][2] = { {640, 480}, {1280, 720}, {1920, 1080}, {97, 61} };
+
+	for (int s = 0; s < 4; s++) {
+		Mat frame(sizes[s][1], sizes[s][0], CV_8UC3);
+		Mat colorOutput;
+		Mat labels(frame.rows, frame.cols, CV_8UC1);
+
+		for (int round = 0; round < 50; round++) {
+			// Noise with a few solid blobs so every band has some matches
+			randu(frame, Scalar(0,0,0), Scalar(256,256,256));
+			for (int b = 0; b < 6; b++) {
+				Point centre(rng.uniform(0, frame.cols), rng.uniform(0, frame.rows));
+				circle(frame, centre, rng.uniform(5, 60), Scalar(rng.uniform(0,256), rng.uniform(0,256),
+						rng.uniform(0,256)), -1);
+			}
+			Scalar darker(rng.uniform(0,200), rng.uniform(0,200), rng.uniform(0,200));
+			Scalar brighter(darker[0] + rng.uniform(0,120), darker[1] + rng.uniform(0,120),
+					darker[2] + rng.uniform(0,120));
+			if (round % 10 == 0) {
+				darker = Scalar(0,164,164);
+				brighter = Scalar(125,255,255);
+			}
+			inRange(frame, darker, brighter, colorOutput);
+
+			// The label path, with the band as the second of two overlapping classes
+			ColourClassifier classes;
+			classes.add(Scalar(10,10,194), Scalar(125,125,249));
+			int bit = classes.add(darker, brighter);
+			classes.label(frame, Rect(0, 0, frame.cols, frame.rows), labels);
+
+			for (int w = 0; w < 20; w++) {
+				int x0 = rng.uniform(0, frame.cols), y0 = rng.uniform(0, frame.rows);
+				Rect window = Rect(x0, y0, rng.uniform(1, frame.cols - x0 + 1),
+						rng.uniform(1, frame.rows - y0 + 1));
+				ComMoments fast = bandMoments(frame, window, darker, brighter);
+				ComMoments labelled = labelMoments(labels, window, bit);
+
+				// The original loop, with 64-bit sums so that large windows can be compared too
+				int64 xMass = 0, yMass = 0, sMass = 0, m;
+				for (int y = window.y; y < window.y + window.height; y++) {
+					for (int x = window.x; x < window.x + window.width; x++) {
+						m = colorOutput.at<unsigned char>(y,x);
+						sMass += m;
+						xMass += m*x;
+						yMass += m*y;
+					}
+				}
+				checks++;
+				if (fast.sMass != sMass || fast.xMass != xMass || fast.yMass != yMass
+						|| labelled.sMass != sMass || labelled.xMass != xMass || labelled.yMass != yMass) {
+					failures++;
+					printf("mismatch at %dx%d window (%d,%d %dx%d)\n", frame.cols, frame.rows,
+							window.x, window.y, window.width, window.height);
+				}
+			}
+		}
+	}
+
+	printf("bandMoments and labelMoments: %d/%d windows match the inRange reference\n", checks - failures, checks);
+	return failures;
+}
+
+	// One booth's match: its two cameras, the six trackers, the game windows and the result.
+	// The Engine steps it one frame at a time; while a frame is stepped, the arena's state belongs
+	// to the tasks the engine runs for it: one per camera for tracking and placing, one for rendering.
+class Arena {
+public:
+	int number;			// 1, 2, ...
+	string suffix;			// added to the window names, "" when there is only one arena
+	string name1, name2;		// players' names
+	string winner;			// "" until a player runs out of stamina
+	const GameSettings *settings;
+	bool fullRedraw;
+	bool headless;
+
+	FrameSource *source1, *source2;
+	bool threaded;			// live cameras, read by capture threads
+	CaptureThread capture1, capture2;
+	int64 stamp1, stamp2;		// when the current frames were read
+	bool new1, new2;		// the frame of each player is new this round; a camera that has
+					// nothing new leaves its player as last placed, and its frame untracked
+	Mat frame, frame2;
+	Mat view1, view2;		// the frames in BGR with the ROIs drawn, empty while not needed
+	BufferPool *buffers;		// frame-sized buffers, made once the frame size is known
+	Mat game, game2;
+
+	Physics physics;		// per-frame state of all six trackers
+	moTracker p1, p1LHand, p1RHand;
+	moTracker p2, p2LHand, p2RHand;
+	CameraCache camera1, camera2;	// masks, pyramid and blobs of each camera's current frame
+	GameRenderer renderer;
+	EventLog events;
+	string logPath;
+	FramePacer pacer;		// this arena's frame deadlines
+
+	int frameCount;			// frames stepped
+	bool finished;			// the recordings ran out or the frame limit was reached
+	time_t started;
+	int64 startTicks;
+
+	// Tasks of a frame, built once and submitted every frame
+	function<void()> track1, track2, place1, place2, render;
+
+	Arena (int set_number, bool several, string set_name1, string set_name2, const GameSettings &set_settings)
+			: p1(physics, Physics::P1), p1LHand(physics, Physics::P1L), p1RHand(physics, Physics::P1R),
+			p2(physics, Physics::P2), p2LHand(physics, Physics::P2L), p2RHand(physics, Physics::P2R),
+			renderer(set_name1, set_name2), pacer(FramePacer::UNPACED, 0.0) {
+		number = set_number;
+		if (several) {
+			suffix = " (arena " + intText(number) + ")";
+		}
+		name1 = set_name1;
+		name2 = set_name2;
+		settings = &set_settings;
+		fullRedraw = false;
+		headless = false;
+		source1 = source2 = NULL;
+		threaded = false;
+		stamp1 = stamp2 = 0;
+		new1 = new2 = true;
+		buffers = NULL;
+		frameCount = 0;
+		finished = false;
+		started = 0;
+		startTicks = 0;
+	}
+	~Arena () {
+		capture1.stop();
+		capture2.stop();
+		delete source1;
+		delete source2;
+		delete buffers;
+	}
+
+	// Open the players' sources and set the match up on their first frames.
+	// "fpsSpec" is as for "-fps"; "set_logPath" is where the events go, "" for nowhere.
+	bool open (string spec1, string spec2, string fpsSpec, bool set_headless, bool set_fullRedraw, string set_logPath) {
+		fullRedraw = set_fullRedraw;
+		headless = set_headless;
+		source1 = openSource(spec1, 1);
+		source2 = openSource(spec2, 2);
+		if (source1 == NULL || !source1->isOpened() || source2 == NULL || !source2->isOpened()) {
+			return false;
+		}
+
+		// Live cameras get one capture thread each and only their newest frames are tracked.
+		// Recorded and synthetic sources are read in order, so every run is the same.
+		threaded = source1->live() || source2->live();
+		if (threaded) {
+			capture1.start(*source1);
+			capture2.start(*source2);
+			if (!capture1.waitFirst() || !capture2.waitFirst()) {
+				printf("%s delivered no frames\n", capture1.failed ? spec1.c_str() : spec2.c_str());
+				return false;
+			}
+			capture1.latest(frame, stamp1);
+			capture2.latest(frame2, stamp2);
+		} else if (!source1->read(frame) || !source2->read(frame2)) {
+			return false;
+		}
+
+		// Frame pacing
+		if (fpsSpec.empty()) {
+			fpsSpec = threaded ? "camera" : headless ? "0" : "30";
+		}
+		pacer = FramePacer(FramePacer::FIXED, atof(fpsSpec.c_str()));
+		if (fpsSpec == "camera") {
+			pacer = FramePacer(FramePacer::CAMERA, max(source1->fps(), source2->fps()));
+		} else if (atof(fpsSpec.c_str()) <= 0.0) {
+			pacer = FramePacer(FramePacer::UNPACED, 0.0);
+		}
+
+		// Frame-sized buffers of the whole match: game windows, frames of recorded sources
+		// (live ones have their capture ring), the renderer's layers, BGR copies of YUYV cameras
+		// and two colour masks per camera
+		int yuyvCameras = (frame.type() == CV_8UC2) + (frame2.type() == CV_8UC2);
+		buffers = new BufferPool(frame.rows, frame.cols, 6 + yuyvCameras, 6);
+		if (!threaded) {
+			buffers->adopt(frame);
+			buffers->adopt(frame2);
+		}
+		game = buffers->take(CV_8UC3);
+		game2 = buffers->take(CV_8UC3);
+		camera1.masks.useBuffers(*buffers);
+		camera2.masks.useBuffers(*buffers);
+		useClasses();
+		renderer.useBuffers(*buffers);
+		physics.separateOwn = !settings->tracking.blobs;
+		setupPlayers(frame, frame2, *settings, p1, p1LHand, p1RHand, p2, p2LHand, p2RHand);
+
+		logPath = set_logPath;
+		if (!logPath.empty() && !events.open(logPath, frame.cols, frame.rows, name1, name2)) {
+			printf("Cannot write event log %s\n", logPath.c_str());
+			return false;
+		}
+
+		track1 = [this] { feedPlayer(frame, frameCount, camera1, *settings, p1, p1LHand, p1RHand); };
+		track2 = [this] { feedPlayer(frame2, frameCount, camera2, *settings, p2, p2LHand, p2RHand); };
+		place1 = [this] { place(frame, camera1, view1, p1, p1LHand, p1RHand); };
+		place2 = [this] { place(frame2, camera2, view2, p2, p2LHand, p2RHand); };
+		render = [this] { drawFrame(); };
+
+		if (!headless) {
+			namedWindow(window("Player 1 ROI"), CV_WINDOW_NORMAL);
+			namedWindow(window("Player 2 ROI"), CV_WINDOW_NORMAL);
+			namedWindow(window("Boxing Game 1"), CV_WINDOW_NORMAL);
+			namedWindow(window("Boxing Game 2"), CV_WINDOW_NORMAL);
+		}
+		started = time(NULL);
+		startTicks = getTickCount();
+		return true;
+	}
+
+	// Take the colour classes of the current settings (after they were reloaded)
+	void useClasses () {
+		camera1.masks.useClasses(settings->classifier());
+		camera2.masks.useClasses(settings->classifier());
+	}
+
+	string window (string name) const {
+		return name + suffix;
+	}
+
+	// Get this frame's camera frames. False if there is nothing new to track yet (live cameras)
+	// or the recordings ran out, which finishes the arena.
+	bool grab () {
+		if (threaded) {
+			// the newest frames from the cameras, without waiting for them
+			if (capture1.failed || capture2.failed) {
+				// a camera went away: the match ends as if its recording ran out
+				finished = true;
+				return false;
+			}
+			// (a frame that is not new was tracked and drawn on already)
+			new1 = capture1.latest(frame, stamp1);
+			new2 = capture2.latest(frame2, stamp2);
+			probeCameras();
+			return new1 || new2;
+		}
+		if (frameCount > 0) {
+			// next recorded frame of each player; the match ends with the shorter recording
+			stamp1 = stamp2 = getTickCount();
+			if (!source1->read(frame) || !source2->read(frame2)) {
+				finished = true;
+				return false;
+			}
+		}
+		probeCameras();
+		return true;
+	}
+
+	void probeCameras () {
+		PROBE(if (instruments.watched == &physics) { instruments.cameraAge(0, stamp1); instruments.cameraAge(1, stamp2); });
+	}
+
+	// Move one player's ROIs to their final position and draw them on the frame in BGR. A YUYV frame
+	// is only converted whole when there are windows to show it in.
+	void place (Mat frame, CameraCache &camera, Mat &view, moTracker &head, moTracker &lHand, moTracker &rHand) {
+		if (headless && frame.type() == CV_8UC2) {
+			updatePlayerROI(frame, head, lHand, rHand);
+			view = Mat();
+			return;
+		}
+		view = camera.masks.colour(frame, frameCount, Rect(0, 0, frame.cols, frame.rows));
+		placePlayer(view, head, lHand, rHand);
+	}
+
+	// Draw the game windows, or the end screens once a player ran out of stamina (a task of its own)
+	void drawFrame () {
+		if (p1.wBar != 0 && p2.wBar != 0) {
+			PROBE(int64 renderStart = getTickCount());
+			if (fullRedraw) {
+				drawGame(game, game2, p1, p1LHand, p1RHand, p2, p2LHand, p2RHand);
+				labelViews(game, game2, name1, name2);
+			} else {
+				renderer.drawScene(game, game2, p1, p1LHand, p1RHand, p2, p2LHand, p2RHand);
+				renderer.finishViews(game, game2);
+			}
+			PROBE(if (instruments.watched == &physics) instruments.renderTicks += getTickCount() - renderStart);
+			return;
+		}
+
+		// Each player's window says how the match went for them
+		winner = p1.wBar == 0 ? name2 : name1;
+		Mat winView = p1.wBar == 0 ? game2 : game;
+		Mat loseView = p1.wBar == 0 ? game : game2;
+		rectangle (winView, Rect(0,0, frame.cols, frame.rows), Scalar (0,0,0), -1);
+		putText(winView, "You Win!", Point(80,300), FONT_HERSHEY_TRIPLEX, 3, Scalar(0,0,255), 2, 8);
+		rectangle (loseView, Rect(0,0, frame.cols, frame.rows), Scalar (0,0,0), -1);
+		putText(loseView, "You Lose!", Point(70,250), FONT_HERSHEY_TRIPLEX, 3, Scalar(0,0,255), 2, 8);
+		// the end screens were drawn over the game windows
+		renderer.invalidate();
+	}
+
+	// Show this frame's windows (HighGUI is only used from the engine's thread)
+	void show (bool overlay) {
+		PROBE(if (overlay && instruments.watched == &physics && !view1.empty()) { instruments.drawOverlay(view1, 0); });
+		PROBE(if (overlay && instruments.watched == &physics && !view2.empty()) { instruments.drawOverlay(view2, 1); });
+		if (headless) {
+			return;
+		}
+		imshow(window("Player 1 ROI"), view1);
+		imshow(window("Player 2 ROI"), view2);
+		imshow(window("Boxing Game 1"), game);
+		imshow(window("Boxing Game 2"), game2);
+	}
+
+	// Close the frame: record its events and move to the next frame slot
+	void endFrame () {
+		events.recordFrame(frameCount, physics, p1, p2);
+		PROBE(if (instruments.watched == &physics) instruments.endFrame(frameCount));
+		pacer.finish();
+		frameCount++;
+	}
+
+	// Add the finished match to the history and close its event log
+	void record (MatchHistory *history) {
+		if (history != NULL) {
+			MatchRecord match;
+			memset(&match, 0, sizeof(match));
+			MatchHistory::copyName(match.player1, name1);
+			MatchHistory::copyName(match.player2, name2);
+			MatchHistory::copyName(match.winner, winner);
+			match.started = started;
+			match.durationMs = (int) ((getTickCount() - startTicks)*1000/getTickFrequency());
+			match.frames = frameCount;
+			match.hits1 = (short) p2.hitsTaken;
+			match.hits2 = (short) p1.hitsTaken;
+			if (!history->add(match)) {
+				printf("Cannot record the match of arena %d\n", number);
+			}
+		}
+		events.recordEnd(winner);
+		events.close();
+		capture1.stop();
+		capture2.stop();
+	}
+
+	void printStats () {
+		char title[32];
+		if (suffix.empty()) {
+			snprintf(title, sizeof(title), "Final");
+		} else {
+			snprintf(title, sizeof(title), "Arena %d final", number);
+		}
+
+		// Final state of the match, so that replays of the same recording can be compared
+		printf("%s state: p1 (%d,%d) L(%d,%d) R(%d,%d) hits %d, p2 (%d,%d) L(%d,%d) R(%d,%d) hits %d, winner \"%s\"\n",
+				title,
+				p1.xCOM(), p1.yCOM(), p1LHand.xCOM(), p1LHand.yCOM(), p1RHand.xCOM(), p1RHand.yCOM(), p1.hitNo,
+				p2.xCOM(), p2.yCOM(), p2LHand.xCOM(), p2LHand.yCOM(), p2RHand.xCOM(), p2RHand.yCOM(), p2.hitNo,
+				winner.c_str());
+		printf("Final frameCount = %d \n", frameCount);
+		pacer.printStats();
+		if (!logPath.empty()) {
+			events.printStats(logPath);
+		}
+		if (!fullRedraw) {
+			renderer.printStats(frame.cols, frame.rows);
+		}
+		printf("Buffer pool %.1f MB, %lld overflows\n", buffers->arena.total()/1048576.0,
+				(long long) buffers->overflows);
+
+		// Time spent on colour detection by each tracker
+		p1.printTiming("p1");
+		p1LHand.printTiming("p1LHand");
+		p1RHand.printTiming("p1RHand");
+		p2.printTiming("p2");
+		p2LHand.printTiming("p2LHand");
+		p2RHand.printTiming("p2RHand");
+		camera1.masks.printStats("camera 1");
+		camera2.masks.printStats("camera 2");
+		if (settings->tracking.blobs) {
+			camera1.blobs.printStats("camera 1");
+			camera2.blobs.printStats("camera 2");
+		}
+		if (threaded) {
+			capture1.printStats("camera 1");
+			capture2.printStats("camera 2");
+		}
+	}
+};
+
+	// Runs any number of arenas on one shared worker pool. Each round steps every arena whose next
+	// frame is due by its own deadline and whose camera frames are in: the tracking tasks of all of
+	// them run across the pool together, then their placing and rendering tasks. The cores are shared
+	// by all the booths instead of each booth's process starting threads of its own. Windows are only
+	// used from the thread calling step(), as HighGUI requires.
+class Engine {
+public:
+	vector<Arena *> arenas;
+	vector<Arena *> due;		// arenas stepped in this round
+	WorkerPool pool;
+	bool serial;			// run every task on the calling thread
+	bool headless;
+	bool overlay;
+
+	// Counters
+	int64 rounds;
+	int64 frames;			// arena frames stepped
+	int64 busyTicks;		// time spent stepping, excluding waits for deadlines and cameras
+
+	Engine (const vector<Arena *> &set_arenas, int workers, bool set_serial, bool set_headless, bool set_overlay)
+			: arenas(set_arenas), pool(set_serial ? 0 : workers) {
+		due.reserve(arenas.size());
+		serial = set_serial;
+		headless = set_headless;
+		overlay = set_overlay;
+		rounds = 0;
+		frames = 0;
+		busyTicks = 0;
+	}
+
+	// One round. Returns false once every arena has finished or "maxFrames" frames, or a key was pressed.
+	bool step (int maxFrames) {
+		int64 now = getTickCount();
+		int64 wake = 0;		// earliest start of a frame slot still to come
+		bool active = false;
+
+		due.clear();
+		for (size_t i = 0; i < arenas.size(); i++) {
+			Arena *a = arenas[i];
+			if (a->finished || a->frameCount >= maxFrames) {
+				a->finished = true;
+				continue;
+			}
+			active = true;
+			if (!a->pacer.due(now)) {
+				wake = wake == 0 ? a->pacer.wakeAt() : min(wake, a->pacer.wakeAt());
+			} else if (a->grab()) {
+				due.push_back(a);
+			}
+		}
+		if (!active) {
+			return false;
+		}
+
+		if (due.empty()) {
+			// Nothing to track yet: sleep until the next slot, or briefly while cameras deliver
+			int ms = 1;
+			if (wake > now) {
+				ms = max(1, (int) ((wake - now)*1000/getTickFrequency()));
+			}
+			if (headless) {
+				this_thread::sleep_for(chrono::milliseconds(ms));
+				return true;
+			}
+			return waitKey(ms) < 0; // returns early if a key is pressed
+		}
+
+		// Each player's camera is tracked on its own task; the players only meet after the barrier.
+		// A player whose camera has no new frame is not tracked or placed again this round.
+		for (size_t i = 0; i < due.size(); i++) {
+			due[i]->pacer.begin();
+			if (due[i]->new1) {
+				run(due[i]->track1);
+			}
+			if (due[i]->new2) {
+				run(due[i]->track2);
+			}
+		}
+		barrier();
+
+		// Keep heads and fists apart and decide the hits, for both players of each arena in one pass
+		for (size_t i = 0; i < due.size(); i++) {
+			due[i]->physics.resolveCollisions(due[i]->frame.cols, due[i]->frame.rows);
+		}
+
+		// Final positions of the ROIs on the camera frames, and the game windows
+		for (size_t i = 0; i < due.size(); i++) {
+			if (due[i]->new1) {
+				run(due[i]->place1);
+			}
+			if (due[i]->new2) {
+				run(due[i]->place2);
+			}
+			run(due[i]->render);
+		}
+		barrier();
+
+		for (size_t i = 0; i < due.size(); i++) {
+			due[i]->show(overlay);
+			due[i]->endFrame();
+		}
+		rounds++;
+		frames += due.size();
+		busyTicks += getTickCount() - now;
+
+		// poll the keyboard and let the windows redraw
+		return headless || waitKey(1) < 0;
+	}
+
+	void printStats () {
+		printf("Engine: %d arenas, %lld rounds, %lld arena frames, %.3f ms busy per round (",
+				(int) arenas.size(), (long long) rounds, (long long) frames,
+				rounds ? busyTicks*1000.0/getTickFrequency()/rounds : 0.0);
+		if (serial) {
+			printf("serial)\n");
+		} else {
+			printf("%d workers)\n", (int) pool.workers.size());
+		}
+	}
+
+private:
+	void run (const function<void()> &task) {
+		if (serial) {
+			task();
+		} else {
+			pool.submit(task);
+		}
+	}
+
+	void barrier () {
+		if (!serial) {
+			pool.wait();
+		}
+	}
+};
+
+// Compare the worker pool with "-serial": track the same synthetic match headless, unpaced, for "frames"
+// frames at several resolutions, once on the calling thread and once on "workers" threads, and report
+// the time per frame of each and whether both ended with the same positions and hits.
+int runPoolBench (int frames, const GameSettings &settings, int workers) {
+	int sizes[][2] = { {640, 480}, {1280, 720}, {1920, 1080} };
+	int differ = 0;
+
+	printf("%d frames, %d workers, %u hardware threads\n", frames, workers, thread::hardware_concurrency());
+	printf("  %-10s %12s %12s %8s  %s\n", "size", "serial ms", "pool ms", "speedup", "same result");
+	for (int r = 0; r < 3; r++) {
+		string spec = "synthetic:" + intText(sizes[r][0]) + "x" + intText(sizes[r][1]);
+		double ms[2];
+		Physics end[2];
+		int hits[2][2];
+		for (int pass = 0; pass < 2; pass++) {
+			Arena arena(1, false, "Player1", "Player2", settings);
+			if (!arena.open(spec, spec, "0", true, false, "")) {
+				printf("Cannot open %s\n", spec.c_str());
+				return -1;
+			}
+			vector<Arena *> arenas(1, &arena);
+			Engine engine(arenas, workers, pass == 0, true, false);
+			while (engine.step(frames)) {
+			}
+			ms[pass] = engine.rounds ? engine.busyTicks*1000.0/getTickFrequency()/engine.rounds : 0.0;
+			end[pass] = arena.physics;
+			hits[pass][0] = arena.p1.hitsTaken;
+			hits[pass][1] = arena.p2.hitsTaken;
+		}
+
+		bool same = hits[0][0] == hits[1][0] && hits[0][1] == hits[1][1];
+		for (int i = 0; i < Physics::N; i++) {
+			same = same && end[0].xCOM[i] == end[1].xCOM[i] && end[0].yCOM[i] == end[1].yCOM[i];
+		}
+		differ += !same;
+		printf("  %4dx%-5d %12.3f %12.3f %7.2fx  %s\n", sizes[r][0], sizes[r][1], ms[0], ms[1],
+				ms[1] > 0.0 ? ms[0]/ms[1] : 0.0, same ? "yes" : "NO");
+	}
+	return differ;
+}
+
+// Ask for a player's name: one word, at most what the match history stores
+string askName (string prompt, string fallback) {
+	char name[MatchRecord::NAME_LEN];
+	printf("%s\n", prompt.c_str());
+	if (scanf("%31s", name) != 1) {	// 31 = MatchRecord::NAME_LEN - 1
+		return fallback;
+	}
+	scanf("%*[^\n]");	// drop the rest of a longer name
+	return name;
+}
+
+// Print the leaderboard ("top" > 0) or one player's totals from the match history
+int queryHistory (string historyPath, int top, string player) {
+	MatchHistory history;
+	if (!history.open(historyPath)) {
+		printf("Cannot open match history %s\n", historyPath.c_str());
+		return -1;
+	}
+	printf("%lld matches in %s\n", (long long) history.count(), historyPath.c_str());
+	if (top > 0) {
+		vector<pair<string, MatchHistory::PlayerStats> > leaders = history.top(top);
+		for (size_t i = 0; i < leaders.size(); i++) {
+			printf("%2d. %-31s %5d wins %5d losses %5d played\n", (int) i + 1, leaders[i].first.c_str(),
+					leaders[i].second.wins, leaders[i].second.losses, leaders[i].second.played);
+		}
+	}
+	if (!player.empty()) {
+		MatchHistory::PlayerStats stats = history.stats(player);
+		printf("%s: %d wins, %d losses, %d played\n", player.c_str(), stats.wins, stats.losses, stats.played);
+	}
+	return 0;
+}
+
+int main(  int argc, char** argv ) {
+
+	// "-mask" uses the inRange mask path instead of the fused kernel,
+	// "-fullframe" makes that path (or the "-labels" one) threshold the whole frame, to compare timings
+	// with the ROI-only paths
+	// "-checkkernel" checks the fused kernel and the colour-class labels against inRange and exits
+	// "-serial" tracks both players on the main thread, to compare with the worker pool
+	// "-benchpool" times the worker pool against "-serial" on synthetic matches ("-frames", "-workers")
+	// "-arenas N" runs N matches at once on one worker pool, arena k on cameras 2k-2 and 2k-1 (see Engine);
+	// "-sources K SPEC1 SPEC2" gives arena K other sources, "-workers N" sizes the pool
+	// "-source1 SPEC" / "-source2 SPEC" choose where each player's frames come from (see openSource)
+	// "-headless" runs without windows and name prompts, as fast as the sources allow
+	// "-frames N" stops after N frames
+	// "-fps N" paces the loop to N frames per second, "-fps camera" follows the cameras, "-fps 0" does not pace
+	// (default: camera for live cameras, unpaced when headless, otherwise 30)
+	// "-bench" runs the per-stage benchmark on synthetic frames ("-report FILE" sets where its JSON goes)
+	// "-predict" searches a small window around each tracker's predicted position instead of its ROI
+	// "-blobs" labels each colour band once per frame and gives each tracker the nearest component
+	// "-labels" labels every colour class of a region in one pass and has all trackers read that label image
+	// "-pyramid H,F" finds heads on pyramid level H and fists on level F, then refines at full resolution
+	// "-punchspeed X" makes the benchmark's synthetic players punch X times as fast
+	// "-fullredraw" clears and redraws the whole game windows every frame instead of only what changed
+	// "-benchcollide" compares the collision code with the trigonometric version it replaced
+	// "-log FILE" records the match's events to FILE (see EventLog)
+	// "-replay FILE" re-renders a recorded match as fast as possible, "-rescore FILE" only recomputes its scores
+	// "-tune CORPUS" tracks every match listed in CORPUS headless on all cores (see runTuning) with each
+	// combination of the "-sweep KEY=V1,V2,..." values and ranks them ("-report FILE", default tune_report.csv);
+	// synthetic sources never end, so give "-frames" with them
+	// "-history FILE" keeps the match history in FILE instead of matches.db
+	// "-leaderboard N" prints the N players with the most wins, "-player NAME" one player's totals
+	// "-overlay" shows the instrumentation counters on the ROI windows, "-instrument FILE" dumps them
+	// to FILE (CSV, or JSON lines if FILE ends in .json); both need a build with -DBOXING_INSTRUMENT
+	// "-config FILE" reads the settings from FILE instead of boxing.cfg (see GameSettings); the colour
+	// bands are read again whenever the file changes during a match
+	GameSettings settings;
+	TrackerOptions &tracking = settings.tracking;	// the flags below override the settings file
+	string configPath = "boxing.cfg";
+	bool configGiven = false;
+	bool serial = false;
+	bool headless = false;
+	int maxFrames = 100000000;
+	string source1Spec = "cam:0", source2Spec = "cam:1";
+	bool bench = false;
+	bool benchPool = false;
+	bool fullRedraw = false;
+	double punchSpeed = 1.0;
+	string fpsSpec = "";
+	string reportPath = "";
+	string logPath = "";
+	string replayPath = "";
+	bool replayRender = false;
+	string historyPath = "matches.db";
+	int leaderboard = 0;
+	string playerQuery = "";
+	bool overlay = false;
+	string instrumentPath = "";
+	int arenaCount = 1;
+	const int maxArenas = 16;
+	vector<pair<string, string> > arenaSources(maxArenas + 1);	// by arena number, "" for the default
+	int workers = 0;	// 0 sizes the pool for the arenas, or for the machine when tuning
+	string corpusPath = "";
+	vector<string> sweeps;
+
+	// Count Mat buffers along with operator new (see AllocationCount)
+	static CountingMatAllocator countingAllocator;
+	Mat::setDefaultAllocator(&countingAllocator);
+
+	// Settings first, so that the flags can override them
+	for (int i = 1; i + 1 < argc; i++) {
+		if (string(argv[i]) == "-config") {
+			configPath = argv[i + 1];
+			configGiven = true;
+		}
+	}
+	time_t configTime = modifiedTime(configPath);
+	if (configGiven || configTime != 0) {
+		string error;
+		if (!settings.load(configPath, error)) {
+			printf("Settings: %s\n", error.c_str());
+			return -1;
+		}
+	}
+
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "-config" && i + 1 < argc) {
+			i++; // read above
+		} else if (string(argv[i]) == "-mask") {
+			tracking.fused = false;
+		} else if (string(argv[i]) == "-fullframe") {
+			tracking.fused = false;
+			tracking.roiOnly = false;
+		} else if (string(argv[i]) == "-serial") {
+			serial = true;
+		} else if (string(argv[i]) == "-headless") {
+			headless = true;
+		} else if (string(argv[i]) == "-source1" && i + 1 < argc) {
+			source1Spec = argv[++i];
+		} else if (string(argv[i]) == "-source2" && i + 1 < argc) {
+			source2Spec = argv[++i];
+		} else if (string(argv[i]) == "-arenas" && i + 1 < argc) {
+			arenaCount = min(max(atoi(argv[++i]), 1), maxArenas);
+		} else if (string(argv[i]) == "-sources" && i + 3 < argc) {
+			int k = atoi(argv[i + 1]);
+			if (k >= 1 && k <= maxArenas) {
+				arenaSources[k] = make_pair(string(argv[i + 2]), string(argv[i + 3]));
+			}
+			i += 3;
+		} else if (string(argv[i]) == "-workers" && i + 1 < argc) {
+			workers = atoi(argv[++i]);
+		} else if (string(argv[i]) == "-tune" && i + 1 < argc) {
+			corpusPath = argv[++i];
+		} else if (string(argv[i]) == "-sweep" && i + 1 < argc) {
+			sweeps.push_back(argv[++i]);
+		} else if (string(argv[i]) == "-frames" && i + 1 < argc) {
+			maxFrames = atoi(argv[++i]);
+		} else if (string(argv[i]) == "-fps" && i + 1 < argc) {
+			fpsSpec = argv[++i];
+		} else if (string(argv[i]) == "-predict") {
+			tracking.predictive = true;
+		} else if (string(argv[i]) == "-blobs") {
+			tracking.blobs = true;
+		} else if (string(argv[i]) == "-labels") {
+			tracking.labels = true;
+		} else if (string(argv[i]) == "-pyramid" && i + 1 < argc) {
+			sscanf(argv[++i], "%d,%d", &tracking.headLevel, &tracking.fistLevel);
+		} else if (string(argv[i]) == "-punchspeed" && i + 1 < argc) {
+			punchSpeed = atof(argv[++i]);
+		} else if (string(argv[i]) == "-fullredraw") {
+			fullRedraw = true;
+		} else if (string(argv[i]) == "-bench") {
+			bench = true;
+		} else if (string(argv[i]) == "-report" && i + 1 < argc) {
+			reportPath = argv[++i];
+		} else if (string(argv[i]) == "-benchpool") {
+			benchPool = true;
+		} else if (string(argv[i]) == "-benchcollide") {
+			return runCollisionBench(200);
+		} else if (string(argv[i]) == "-checkkernel") {
+			return checkKernel() == 0 ? 0 : 1;
+		} else if (string(argv[i]) == "-log" && i + 1 < argc) {
+			logPath = argv[++i];
+		} else if ((string(argv[i]) == "-replay" || string(argv[i]) == "-rescore") && i + 1 < argc) {
+			replayRender = string(argv[i]) == "-replay";
+			replayPath = argv[++i];
+		} else if (string(argv[i]) == "-history" && i + 1 < argc) {
+			historyPath = argv[++i];
+		} else if (string(argv[i]) == "-leaderboard" && i + 1 < argc) {
+			leaderboard = atoi(argv[++i]);
+		} else if (string(argv[i]) == "-player" && i + 1 < argc) {
+			playerQuery = argv[++i];
+		} else if (string(argv[i]) == "-overlay") {
+			overlay = true;
+		} else if (string(argv[i]) == "-instrument" && i + 1 < argc) {
+			instrumentPath = argv[++i];
+		}
+	}
+
+	string settingsError;
+	if (!settings.validate(settingsError)) {
+		printf("Settings: %s\n", settingsError.c_str());
+		return -1;
+	}
+
+#ifdef BOXING_INSTRUMENT
+	if (!instrumentPath.empty() && !instruments.openDump(instrumentPath)) {
+		printf("Cannot write instrumentation dump %s\n", instrumentPath.c_str());
+		return -1;
+	}
+#else
+	if (overlay || !instrumentPath.empty()) {
+		printf("Built without BOXING_INSTRUMENT: -overlay and -instrument are ignored\n");
+	}
+#endif
+
+	if (leaderboard > 0 || !playerQuery.empty()) {
+		return queryHistory(historyPath, leaderboard, playerQuery);
+	}
+
+	if (!replayPath.empty()) {
+		return runReplay(replayPath, settings, replayRender, headless) == 0 ? 0 : 1;
+	}
+
+	if (!corpusPath.empty()) {
+		if (workers <= 0) {
+			workers = max(1, (int) thread::hardware_concurrency());
+		}
+		return runTuning(corpusPath, settings, sweeps, maxFrames, serial ? 0 : workers,
+				reportPath.empty() ? "tune_report.csv" : reportPath) == 0 ? 0 : 1;
+	}
+
+	if (benchPool) {
+		if (workers <= 0) {
+			workers = max(2, min((int) thread::hardware_concurrency(), 3));
+		}
+		return runPoolBench(maxFrames < 100000000 ? maxFrames : 300, settings, workers) == 0 ? 0 : 1;
+	}
+
+	if (bench) {
+		return runBenchmark(maxFrames < 100000000 ? maxFrames : 300, headless, tracking,
+				punchSpeed, fullRedraw, reportPath.empty() ? "bench_report.json" : reportPath);
+	}
+
+	// Record of every match (headless runs are not real matches and are not recorded)
+	MatchHistory history;
+	if (!headless) {
+		if (!history.open(historyPath)) {
+			printf("Cannot open match history %s\n", historyPath.c_str());
+			return -1;
+		}
+		if (history.count() == 0) {
+			int imported = history.importWinners("winners.txt");
+			if (imported > 0) {
+				printf("Imported %d winners from winners.txt into %s\n", imported, historyPath.c_str());
+			}
+		}
+	}
+
+	// Arena k plays on cameras 2k-2 and 2k-1 unless "-sources" says otherwise
+	vector<Arena *> arenas;
+	for (int k = 1; k <= arenaCount; k++) {
+		string spec1 = arenaSources[k].first, spec2 = arenaSources[k].second;
+		if (spec1.empty()) {
+			spec1 = k == 1 ? source1Spec : "cam:" + intText(2*k - 2);
+		}
+		if (spec2.empty()) {
+			spec2 = k == 1 ? source2Spec : "cam:" + intText(2*k - 1);
+		}
+
+		// Players' name, asked for before the arena's cameras start
+		string player1Str = "Player1";
+		string player2Str = "Player2";
+		if (!headless) {
+			string booth = arenaCount > 1 ? " in arena " + intText(k) : "";
+			player1Str = askName("Enter name for Player 1" + booth + ": ", player1Str);
+			player2Str = askName("Enter name for Player 2" + booth + ": ", player2Str);
+		}
+
+		// Arenas after the first log to "FILE.k"
+		string arenaLog = logPath;
+		if (!logPath.empty() && k > 1) {
+			arenaLog += "." + intText(k);
+		}
+
+		Arena *arena = new Arena(k, arenaCount > 1, player1Str, player2Str, settings);
+		arenas.push_back(arena);
+		if (!arena->open(spec1, spec2, fpsSpec, headless, fullRedraw, arenaLog)) {
+			printf("Cannot open arena %d (%s, %s)\n", k, spec1.c_str(), spec2.c_str());
+			for (size_t i = 0; i < arenas.size(); i++) {
+				delete arenas[i];
+			}
+			return -1;
+		}
+	}
+
+	// Two tasks per arena for tracking and three for placing and rendering share the pool
+	if (workers <= 0) {
+		workers = max(2, min((int) thread::hardware_concurrency(), 3*arenaCount));
+	}
+	Engine engine(arenas, workers, serial, headless, overlay);
+	PROBE(instruments.watched = &arenas[0]->physics); // the overlay and the dump follow the first arena
+	AllocationCount allocations; // reset after the first round, which sets everything up
+	bool allocationsReset = false;
+	int64 configChecked = 0;	// round of the last look at the settings file
+
+	while (engine.step(maxFrames)) {
+		// Re-tune the colour bands without reopening the cameras: the workers are idle until the next round
+		if (configTime != 0 && engine.rounds >= configChecked + 30) {
+			configChecked = engine.rounds;
+			if (modifiedTime(configPath) != configTime) {
+				string error;
+				configTime = modifiedTime(configPath);
+				if (settings.reloadBands(configPath, error)) {
+					for (size_t i = 0; i < arenas.size(); i++) {
+						arenas[i]->useClasses();
+					}
+					printf("Settings: colour bands reloaded from %s\n", configPath.c_str());
+				} else {
+					printf("Settings: %s (keeping the previous bands)\n", error.c_str());
+				}
+			}
+		}
+
+		if (!allocationsReset && engine.rounds == 1) {
+			allocations.reset();
+			allocationsReset = true;
+		}
+	}
+
+	// After the games end, record the matches
+	for (size_t i = 0; i < arenas.size(); i++) {
+		arenas[i]->record(headless ? NULL : &history);
+	}
+	PROBE(instruments.closeDump());
+
+	for (size_t i = 0; i < arenas.size(); i++) {
+		arenas[i]->printStats();
+	}
+	engine.printStats();
+	printf("Heap allocations after the first round: %lld operator new, %lld Mat buffers (%lld rounds)\n",
+			allocations.news(), allocations.mats(), (long long) max((int64) 0, engine.rounds - 1));
+
+	for (size_t i = 0; i < arenas.size(); i++) {
+		delete arenas[i];
+	}
 	return 0;
 }